@@ -0,0 +1,31 @@
+#pragma once
+#include <atomic>
+#include <thread>
+
+#include "beeper.h"
+
+// Plays a Beeper on the default output device. A dedicated thread pulls
+// small blocks from the beeper and hands them to the device, so the
+// emulation thread never waits on audio. Backed by ALSA when the build
+// found it (CHIP8_HAVE_ALSA); without a backend open() fails and the
+// frontend simply runs silent.
+class AudioDevice {
+private:
+  static constexpr unsigned int blockFrames = 128; // Samples per write, under 3 ms at 48 kHz
+
+  Beeper &beeper;
+  std::thread thread;
+  std::atomic<bool> running;
+  void *handle; // Backend device
+
+  void run(); // Audio thread
+
+public:
+  AudioDevice(Beeper &beeper) : beeper(beeper), running(false), handle(nullptr) {}
+  ~AudioDevice() { close(); }
+  AudioDevice(const AudioDevice &) = delete;
+  AudioDevice &operator=(const AudioDevice &) = delete;
+
+  bool open(unsigned int sampleRate); // Must match the rate the beeper was built for
+  void close();
+};
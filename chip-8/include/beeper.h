@@ -0,0 +1,48 @@
+#pragma once
+#include "spsc_ring.h"
+
+// The CHIP-8 buzzer. The emulation thread reports every time the tone
+// switches on or off, stamped with the machine cycle it happened on, and the
+// audio thread turns those events into a square wave.
+//
+// Cycles map to samples at a fixed rate, so edges land on the right sample
+// whatever the batch size on either side. The audio side plays every edge
+// half a frame after its place in emulated time, and re-anchors that
+// mapping when the emulation runs ahead, stalls or jumps back (rewind).
+class Beeper {
+private:
+  struct Event {
+    unsigned long long sample; // Cycle converted to samples
+    bool on;
+  };
+
+  SpscRing<Event, 1024> events;
+
+  double samplesPerCycle;
+  double phaseStep; // Tone frequency over sample rate
+  long long latency; // Samples between an event's stamp and when it is heard
+  long long maxLead; // An event further ahead than this re-anchors the clock
+  float volume;
+
+  // -- Producer state, emulation thread only --
+  bool producerOn;
+
+  // -- Consumer state, audio thread only --
+  Event pending;
+  bool hasPending;
+  bool anchored; // offset is valid
+  long long offset; // Output position minus event sample
+  long long position; // Samples rendered so far
+  bool on;
+  double phase;
+
+public:
+  Beeper(unsigned int sampleRate, double cyclesPerSecond, double frequency = 440.0, float volume = 0.25F);
+
+  // Emulation thread. Only changes of state are queued; returns false if the
+  // queue was full and the edge got dropped.
+  bool setTone(unsigned long long cycle, bool on);
+
+  // Audio thread, fills frames mono samples in [-1, 1]
+  void render(float *out, unsigned int frames);
+};
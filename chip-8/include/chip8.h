@@ -1,9 +1,38 @@
 #pragma once
+#include <span>
+#include <vector>
+
+#include "chip8_random.h"
+
+// Instruction dispatch strategies, all produce identical results
+enum Chip8Dispatch {
+  Chip8Dispatch_SWITCH, // Nested switch on every fetched opcode
+  Chip8Dispatch_PREDECODED, // One indirect call through the decoded instruction cache
+  Chip8Dispatch_TABLE, // 65536-entry handler table indexed by the raw opcode
+  Chip8Dispatch_THREADED // Computed goto over the decoded instruction cache (GCC/Clang only)
+};
+
+// Dispatch used by step() and runCycles(), chosen at build time
+#ifndef CHIP8_DISPATCH
+#define CHIP8_DISPATCH THREADED
+#endif
+#define CHIP8_DISPATCH_ENUM_(name) Chip8Dispatch_##name
+#define CHIP8_DISPATCH_ENUM(name) CHIP8_DISPATCH_ENUM_(name)
 
 class Chip8 {
+public:
+  // The tone switching on or off, for audio output
+  struct SoundEdge {
+    unsigned long long cycle; // Instruction count when it happened, to within one instruction
+    bool on;
+  };
+
+  static constexpr unsigned int allRows = 0xFFFFFFFF; // Every bit of getDirtyRows()
+  static constexpr unsigned int maxSoundEdges = 8; // Per clearSoundEdges(), further edges replace the last one
+
 private:
-  bool vram[64 * 32]; // Video RAM
-  bool vramDirty; // Dirty flag for VRAM
+  unsigned long long vram[32]; // Video RAM, one word per row, bit 63 is the leftmost pixel
+  unsigned int dirtyRows; // Bit y set when VRAM row y changed since clearVRAMDirty()
 
   unsigned char memory[4096]; // Memory
 
@@ -20,16 +49,157 @@ private:
 
   unsigned char v[16]; // Registers
 
+  unsigned long long cycles; // Number of executed instructions
+
+  Chip8Random random; // Source for CXNN
+
+  SoundEdge soundEdges[maxSoundEdges]; // Since the last clearSoundEdges()
+  unsigned int soundEdgeCount;
+
+  bool idleSkipping; // Fast-forward wait loops, see skipIdle()
+
+  // -- Decoded instruction cache --
+  struct Instruction;
+  using Handler = void (*)(Chip8 &chip8, const Instruction &instruction);
+
+  // Instruction kinds, in the same order as the handlers in Chip8::Ops
+  enum Op : unsigned char {
+    Op_DECODE, Op_NOP, Op_CLS, Op_RET, Op_JP, Op_CALL, Op_SE_BYTE, Op_SNE_BYTE, Op_SE_REG,
+    Op_LD_BYTE, Op_ADD_BYTE, Op_LD_REG, Op_OR_REG, Op_AND_REG, Op_XOR_REG, Op_ADD_REG,
+    Op_SUB_REG, Op_SHR, Op_SUBN, Op_SHL, Op_SNE_REG, Op_LD_INDEX, Op_JP_OFFSET, Op_RND,
+    Op_DRW, Op_SKP, Op_SKNP, Op_LD_VX_DT, Op_LD_VX_KEY, Op_LD_DT_VX, Op_LD_ST_VX,
+    Op_ADD_INDEX, Op_LD_FONT, Op_LD_BCD, Op_STORE_REGS, Op_LOAD_REGS, Op_COUNT
+  };
+
+  struct Instruction {
+    Handler handler; // Executes the instruction, pc already points past it
+    Op op; // Handler kind, used by the threaded dispatcher
+    unsigned char x, y, n, nn; // Operands extracted from the opcode
+    unsigned short nnn;
+  };
+
+  struct Ops; // Instruction handlers, defined in chip8.cpp
+  friend class Chip8Jit; // Generated code accesses the machine state directly
+  friend class Chip8Lockstep; // Hands machines over mid-run, see Chip8Lockstep::exportMachine()
+
+  Instruction decoded[4096 - 0x200]; // One slot per address in 0x200-0xFFF, decoded on first execution
+
+  static Instruction decode(unsigned short opcode);
+  inline void invalidateDecoded(unsigned short address); // Call after writing memory at address
+
+  void stepUncached(); // Reference fetch/decode/execute, used outside the cached range
+
+  // Dispatch loops, each executes count instructions
+  void runDispatch(unsigned long long count, Chip8Dispatch dispatch); // The loop for dispatch, without idle skipping
+  void runSwitch(unsigned long long count);
+  void runPredecoded(unsigned long long count);
+  void runTable(unsigned long long count);
+  void runThreaded(unsigned long long count);
+
+  // -- Wait loops --
+  // Keys and timers only change between runCycles() calls, so a program that
+  // spins on FX07/3XNN/1NNN, blocks in FX0A or jumps to itself will keep
+  // doing exactly that until the batch ends. runCycles() checks for one every
+  // idleCheckInterval instructions and adds the remaining whole iterations
+  // to cycles in one go, leaving the state as if they had run.
+  static constexpr unsigned long long idleCheckInterval = 128;
+  unsigned int idleLoopLength(unsigned short address) const; // Instructions per iteration of the wait loop starting at address, 0 if there is none
+  unsigned long long alignIdle(unsigned long long count); // Runs to the start of the FX07 loop pc is inside of, returns the instructions run
+  unsigned long long skipIdle(unsigned long long count); // Needs pc at the start of the loop, returns the instructions skipped, at most count
+
   // Helper stuff
   inline void writeMemory(unsigned short address, unsigned char value);
   inline unsigned char readMemory(unsigned short address);
 
-  inline void writePixel(unsigned short x, unsigned short y, bool value);
-  inline bool readPixel(unsigned short x, unsigned short y);
+  inline void drawSprite(unsigned char x, unsigned char y, unsigned char n); // DXYN
+  void drawSpriteVF(unsigned char x, unsigned char y, unsigned char n); // DXYN with VF as a coordinate, pixel by pixel
+  inline void clearScreen(); // 00E0
+  inline void setSoundTimer(unsigned char value); // FX18, records an edge when the tone switches
+  void recordSoundEdge(bool on);
+
+  void loadMemory(unsigned short address, const unsigned char *source, unsigned short length); // Bulk write, keeps the decoded cache valid
 
 public:
-  Chip8(const unsigned char *gameBinaryData, unsigned int gameBinaryDataSize);
+  static constexpr Chip8Dispatch defaultDispatch = CHIP8_DISPATCH_ENUM(CHIP8_DISPATCH);
+  static constexpr unsigned int maxProgramSize = 4096 - 512; // Largest ROM that fits above 0x200
+
+  Chip8(const unsigned char *gameBinaryData, unsigned int gameBinaryDataSize, unsigned long long seed = 0);
+  Chip8(std::span<const unsigned char> rom, unsigned long long seed = 0) : Chip8(rom.data(), (unsigned int)rom.size(), seed) {} // Copied straight into memory, rom can be a mapped file
   ~Chip8();
 
-  int run();
+  // Execution
+  void step(); // Fetch, decode and execute a single instruction
+  void runCycles(unsigned long long count); // Execute count instructions
+  void runCycles(unsigned long long count, Chip8Dispatch dispatch); // Same, with an explicit dispatch strategy
+  void tickTimers(); // Decrement delay and sound timers, call at 60 Hz
+  void predecode(std::span<const unsigned short> addresses); // Fill the decoded cache ahead of time, e.g. from Chip8Analyzer::getInstructions()
+
+  // Same as runCycles(), but calls observer.onInstruction(address, opcode)
+  // before every instruction, e.g. a Chip8Profiler. A separate loop so the
+  // regular dispatch loops carry no hooks.
+  template <typename Observer>
+  void runObserved(unsigned long long count, Observer &observer) {
+    // runPredecoded() with the observer call in front
+    for (unsigned long long i = 0; i < count; i++) {
+      unsigned short address = pc & 0xFFF;
+      observer.onInstruction(address, (memory[address] << 8) | memory[(address + 1) & 0xFFF]);
+
+      if (address < 0x200) {
+        stepUncached();
+        continue;
+      }
+
+      const Instruction &instruction = decoded[address - 0x200];
+      pc += 2;
+      instruction.handler(*this, instruction);
+
+      cycles++;
+    }
+  }
+
+  // Execute instructions until predicate(*this) returns true
+  template <typename Predicate>
+  void runUntil(Predicate predicate) {
+    while (!predicate(*this)) {
+      step();
+    }
+  }
+
+  void seedRandom(unsigned long long seed) { random.seed(seed); } // Same seed, same CXNN sequence
+  void setIdleSkipping(bool enabled) { idleSkipping = enabled; } // On by default, the result is identical either way
+
+  // Input
+  void setKey(unsigned char key, bool pressed);
+  void setKeys(unsigned short keyMask); // Bit i set means key i is pressed
+
+  // Audio. Poll the edges once per frame; the JIT leaves FX18 to the
+  // interpreter so every engine reports them.
+  const SoundEdge *getSoundEdges() const { return soundEdges; }
+  unsigned int getSoundEdgeCount() const { return soundEdgeCount; }
+  void clearSoundEdges() { soundEdgeCount = 0; }
+
+  // Display
+  const unsigned long long *getVRAM() const { return vram; } // 32 rows, see vram
+  bool getPixel(unsigned short x, unsigned short y) const { return (vram[y & 31] >> (63 - (x & 63))) & 1; }
+  bool isVRAMDirty() const { return dirtyRows != 0; }
+  unsigned int getDirtyRows() const { return dirtyRows; } // Bit y for row y, set by DXYN and 00E0 only where the row changed
+  void clearVRAMDirty() { dirtyRows = 0; }
+
+  // Save states, layout described in chip8_snapshot.cpp. A Chip8Jit used with
+  // this machine must be flushed after a restore.
+  std::vector<unsigned char> snapshot() const; // Complete machine state
+  std::vector<unsigned char> snapshotDelta(const std::vector<unsigned char> &base) const; // Only what differs from base, a snapshot() blob. Falls back to a full snapshot if base is not one
+  bool restore(const std::vector<unsigned char> &state); // False, and nothing changed, if state is not a valid snapshot
+  bool restoreDelta(const std::vector<unsigned char> &base, const std::vector<unsigned char> &delta); // Same, for a delta taken against base
+
+  // Inspection
+  unsigned short getPC() const { return pc; }
+  unsigned short getIndex() const { return index; }
+  unsigned short getSP() const { return sp; }
+  unsigned char getRegister(unsigned char x) const { return v[x & 0xF]; }
+  unsigned char getDelayTimer() const { return delayTimer; }
+  unsigned char getSoundTimer() const { return soundTimer; }
+  unsigned char peekMemory(unsigned short address) const { return memory[address & 0xFFF]; }
+  unsigned long long getCycles() const { return cycles; }
+  bool isHalted() const; // True if the instruction at pc jumps to itself
 };
@@ -0,0 +1,88 @@
+#pragma once
+#include <span>
+#include <string>
+#include <vector>
+#include <map>
+#include <stdio.h>
+
+// Static analysis of a classic CHIP-8 ROM. Starting at 0x200 it follows
+// jumps, calls, skips and fall-through to find every reachable
+// instruction, splits them into basic blocks and groups the blocks into
+// subroutines. Nothing is executed, so BNNN targets are not followed and
+// are reported instead, along with FX33/FX55 stores that land on code.
+//
+// The results double as a warm-up list for the engines:
+// Chip8::predecode(getInstructions()) fills the decoded instruction cache
+// and Chip8Jit::precompile(chip8, getBlockStarts()) compiles the blocks
+// before the first frame runs.
+class Chip8Analyzer {
+public:
+  enum EdgeKind : unsigned char {
+    Edge_Fallthrough, // Next instruction, including the return point after a call
+    Edge_Jump, // 1NNN
+    Edge_Skip, // Taken side of a skip, two instructions ahead
+    Edge_Call // 2NNN, to the subroutine entry
+  };
+
+  struct Edge {
+    unsigned short target;
+    EdgeKind kind;
+  };
+
+  struct Block {
+    unsigned short start; // First instruction
+    unsigned short end; // One past the last instruction's second byte
+    std::vector<Edge> successors;
+    bool returns; // Ends in 00EE
+    bool indirect; // Ends in BNNN, successors unknown
+  };
+
+  struct Subroutine {
+    unsigned short entry; // 0x200 for the main program
+    std::vector<unsigned short> blocks; // Block starts reachable without following calls
+    std::vector<unsigned short> callees; // Entries of the subroutines it calls
+  };
+
+  struct Finding {
+    unsigned short address;
+    unsigned short opcode;
+    std::string message;
+  };
+
+private:
+  unsigned char memory[4096];
+  unsigned short romEnd; // One past the last ROM byte
+  bool code[4096]; // An instruction starts here
+  bool leader[4096]; // A block starts here
+  bool callTarget[4096];
+
+  std::map<unsigned short, Block> blocks; // By start address
+  std::vector<Subroutine> subroutines; // Main program first, then by entry
+  std::vector<Finding> findings; // By address
+
+  unsigned short opcodeAt(unsigned short address) const { return (memory[address & 0xFFF] << 8) | memory[(address + 1) & 0xFFF]; }
+
+  void trace(); // Marks reachable instructions and block leaders
+  void buildBlocks();
+  void buildSubroutines();
+  void checkStores(); // Self-modifying FX33/FX55
+  void addFinding(unsigned short address, const std::string &message);
+
+public:
+  Chip8Analyzer(std::span<const unsigned char> rom); // Loaded at 0x200, like Chip8 does
+
+  const std::map<unsigned short, Block> &getBlocks() const { return blocks; }
+  const std::vector<Subroutine> &getSubroutines() const { return subroutines; }
+  const std::vector<Finding> &getFindings() const { return findings; }
+  bool isCode(unsigned short address) const { return code[address & 0xFFF]; }
+
+  std::vector<unsigned short> getInstructions() const; // Every reachable instruction address, ascending
+  std::vector<unsigned short> getBlockStarts() const; // Ascending
+
+  // Output
+  void writeListing(FILE *out) const; // Disassembly of the ROM, data bytes included
+  void writeDot(FILE *out) const; // Graphviz control-flow graph
+  void writeJson(FILE *out) const;
+
+  static std::string disassemble(unsigned short opcode); // Single instruction, e.g. "DRW V0, V1, 15"
+};
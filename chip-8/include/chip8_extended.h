@@ -0,0 +1,140 @@
+#pragma once
+#include <span>
+
+#include "chip8_quirks.h"
+#include "chip8_random.h"
+
+// Machine descriptions for Chip8Extended: memory, framebuffer and opcode
+// set. Behaviour that varied between interpreters is in chip8_quirks.h.
+
+// The original 64x32 CHIP-8, for running it under a quirk profile
+struct Chip8Classic {
+  static constexpr unsigned int memorySize = 4096; // Must be a power of two
+  static constexpr int planes = 1; // Bitplanes, each a 128x64 framebuffer
+  static constexpr bool superChip = false; // Hires, scrolling, 16x16 sprites, big font, RPL flags and 00FD
+  static constexpr bool xoChip = false; // 00DN, 5XY2/5XY3, F000 NNNN, FN01, F002 and FX3A
+  static constexpr int flagRegisters = 0; // FX75/FX85 storage
+  using DefaultQuirks = Chip8QuirksVip;
+};
+
+// SUPER-CHIP 1.1 on the HP-48
+struct Chip8SuperChip {
+  static constexpr unsigned int memorySize = 4096;
+  static constexpr int planes = 1;
+  static constexpr bool superChip = true;
+  static constexpr bool xoChip = false;
+  static constexpr int flagRegisters = 8;
+  using DefaultQuirks = Chip8QuirksSuperChip;
+};
+
+// XO-CHIP: SUPER-CHIP plus 64 KB of memory, two bitplanes and audio patterns
+struct Chip8XoChip {
+  static constexpr unsigned int memorySize = 65536;
+  static constexpr int planes = 2;
+  static constexpr bool superChip = true;
+  static constexpr bool xoChip = true;
+  static constexpr int flagRegisters = 16;
+  using DefaultQuirks = Chip8QuirksModern;
+};
+
+// SUPER-CHIP, XO-CHIP and quirk-accurate CHIP-8 interpreter. The fast
+// classic machine stays in Chip8, with its decoded cache and JIT; this one
+// is a plain switch interpreter, instantiated for every Mode and Quirks
+// pair in chip8_extended.cpp.
+//
+// The framebuffer is always 128x64. In lores mode every pixel is drawn as a
+// 2x2 block and scroll distances are doubled, so a renderer never has to
+// care which resolution is active.
+template <typename Mode, typename Quirks = typename Mode::DefaultQuirks>
+class Chip8Extended {
+private:
+  static constexpr unsigned int addressMask = Mode::memorySize - 1;
+
+  unsigned long long vram[Mode::planes][64][2]; // Per plane, 64 rows of two words, bit 63 of word 0 is the leftmost pixel
+  bool vramDirty; // Dirty flag for VRAM
+  bool hires; // 128x64 when set, otherwise 64x32
+  unsigned char planeMask; // Planes affected by DXYN, scrolling and CLS, set by FN01
+
+  unsigned char memory[Mode::memorySize]; // Memory
+
+  unsigned short stack[16]; // Stack
+  unsigned short sp; // Stack pointer
+
+  unsigned char delayTimer; // Delay timer
+  unsigned char soundTimer; // Sound timer
+
+  bool keys[16]; // Keypad
+
+  unsigned short pc; // Program counter
+  unsigned short index; // Index register
+
+  unsigned char v[16]; // Registers
+  unsigned char flags[16]; // RPL user flags, FX75/FX85
+
+  unsigned char audioPattern[16]; // 128 one-bit samples, F002
+  unsigned char pitch; // FX3A
+
+  bool exited; // Set by 00FD
+  bool frameStarted; // A 60 Hz tick happened since the last draw, for Quirks::displayWait
+
+  unsigned long long cycles; // Number of executed instructions
+
+  Chip8Random random; // Source for CXNN
+
+  void execute(); // Fetch, decode and execute one instruction
+  inline void advanceIndex(unsigned char x); // After FX55/FX65, per Quirks::loadStoreIndex
+  inline void skip(); // Skip the next instruction, which may be four bytes long on XO-CHIP
+
+  void drawSprite(unsigned char x, unsigned char y, unsigned char n); // DXYN, DXY0 draws 16x16
+  bool drawRow(int plane, int y, unsigned int bits, int width, int x); // XOR bits into one row, true on collision
+  void clearPlanes();
+  void scrollVertical(int rows); // Down when positive
+  void scrollHorizontal(int columns); // Right when positive
+
+public:
+  Chip8Extended(const unsigned char *gameBinaryData, unsigned int gameBinaryDataSize, unsigned long long seed = 0);
+  Chip8Extended(std::span<const unsigned char> rom, unsigned long long seed = 0) : Chip8Extended(rom.data(), (unsigned int)rom.size(), seed) {}
+
+  // Execution
+  void step(); // Fetch, decode and execute a single instruction
+  void runCycles(unsigned long long count); // Execute count instructions
+  void tickTimers(); // Decrement delay and sound timers, call at 60 Hz
+
+  // Execute instructions until predicate(*this) returns true
+  template <typename Predicate>
+  void runUntil(Predicate predicate) {
+    while (!predicate(*this)) {
+      step();
+    }
+  }
+
+  void seedRandom(unsigned long long seed) { random.seed(seed); } // Same seed, same CXNN sequence
+
+  // Input
+  void setKey(unsigned char key, bool pressed);
+  void setKeys(unsigned short keyMask); // Bit i set means key i is pressed
+
+  // Display, always 128x64, see vram
+  static constexpr int planeCount = Mode::planes;
+  const unsigned long long *getPlane(int plane) const { return &vram[plane][0][0]; } // 64 rows of two words
+  unsigned char getPixel(unsigned short x, unsigned short y) const; // Bit p is set if plane p is lit
+  bool isHires() const { return hires; }
+  bool isVRAMDirty() const { return vramDirty; }
+  void clearVRAMDirty() { vramDirty = false; }
+
+  // Audio, XO-CHIP only
+  const unsigned char *getAudioPattern() const { return audioPattern; } // 16 bytes
+  unsigned char getPitch() const { return pitch; }
+
+  // Inspection
+  unsigned short getPC() const { return pc; }
+  unsigned short getIndex() const { return index; }
+  unsigned short getSP() const { return sp; }
+  unsigned char getRegister(unsigned char x) const { return v[x & 0xF]; }
+  unsigned char getDelayTimer() const { return delayTimer; }
+  unsigned char getSoundTimer() const { return soundTimer; }
+  unsigned char getPlaneMask() const { return planeMask; }
+  unsigned char peekMemory(unsigned int address) const { return memory[address & addressMask]; }
+  unsigned long long getCycles() const { return cycles; }
+  bool isHalted() const; // True after 00FD, or if the instruction at pc jumps to itself
+};
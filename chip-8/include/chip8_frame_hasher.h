@@ -0,0 +1,39 @@
+#pragma once
+
+// A hash of the display after every frame, for diffing runs frame by frame.
+// Each row's hash is cached and the frame hash is their XOR, so a frame only
+// costs work for the rows Chip8::getDirtyRows() reports as changed.
+class Chip8FrameHasher {
+private:
+  unsigned long long rowHashes[32];
+  unsigned long long frameHash;
+
+  static unsigned long long hashRow(int y, unsigned long long row) {
+    // splitmix64 finalizer, the row index keeps equal rows apart
+    unsigned long long z = row + (y + 1) * 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+  }
+
+public:
+  Chip8FrameHasher() : frameHash(0) {
+    for (int y = 0; y < 32; y++) {
+      rowHashes[y] = hashRow(y, 0);
+      frameHash ^= rowHashes[y];
+    }
+  }
+
+  // Rehashes the rows set in dirtyRows and returns the frame hash
+  unsigned long long update(const unsigned long long *vram, unsigned int dirtyRows) {
+    while (dirtyRows) {
+      int y = __builtin_ctz(dirtyRows);
+      dirtyRows &= dirtyRows - 1;
+
+      unsigned long long hash = hashRow(y, vram[y]);
+      frameHash ^= rowHashes[y] ^ hash;
+      rowHashes[y] = hash;
+    }
+    return frameHash;
+  }
+};
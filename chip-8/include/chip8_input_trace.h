@@ -0,0 +1,46 @@
+#pragma once
+#include <vector>
+
+#include "chip8.h"
+
+// Keypad input stamped with the cycle it took effect on, plus the PRNG seed
+// and frame length of the run. Replaying a trace on a machine built with
+// getSeed(), ticking the timers every getCyclesPerFrame() cycles, reproduces
+// the recorded run bit for bit on any host.
+//
+// Serialized form, little-endian: 'C' '8' 'I' 'T', u8 version, u64 seed,
+// u32 cycles per frame, then one entry per key change: LEB128 cycles since
+// the previous change followed by the u16 key mask.
+class Chip8InputTrace {
+public:
+  struct Event {
+    unsigned long long cycle; // Machine cycle count when the mask was applied
+    unsigned short keyMask; // Bit i set means key i is pressed
+  };
+
+private:
+  unsigned long long seed;
+  unsigned int cyclesPerFrame;
+  std::vector<Event> events; // Ascending cycles, each mask differs from the one before
+
+public:
+  Chip8InputTrace(unsigned long long seed = 0, unsigned int cyclesPerFrame = 1000) : seed(seed), cyclesPerFrame(cyclesPerFrame) {}
+
+  unsigned long long getSeed() const { return seed; }
+  unsigned int getCyclesPerFrame() const { return cyclesPerFrame; }
+  const std::vector<Event> &getEvents() const { return events; }
+
+  // Recording
+  void record(unsigned long long cycle, unsigned short keyMask); // Stores only changes
+  void truncate(unsigned long long cycle); // Forget events from cycle on, for rewinds
+
+  // Replay
+  unsigned short keysAt(unsigned long long cycle) const; // Mask in effect at cycle
+  void runCycles(Chip8 &chip8, unsigned long long count) const; // Execute count instructions, applying each change at its exact cycle
+
+  // Storage
+  std::vector<unsigned char> serialize() const;
+  bool deserialize(const std::vector<unsigned char> &data); // False, and nothing changed, if data is not a trace
+  bool save(const char *path) const;
+  bool load(const char *path);
+};
@@ -0,0 +1,61 @@
+#pragma once
+#include <span>
+#include <vector>
+
+#include "chip8.h"
+
+// Translates CHIP-8 basic blocks into native x86-64 code. Blocks end at jumps
+// (1NNN, 2NNN, 00EE, BNNN) and before any instruction the compiler does not
+// handle, such as DXYN, FX33 or FX55, which are interpreted instead. FX18 is
+// interpreted too, so that it records its sound edge. A skip over an
+// instruction the block can hold is a branch inside the block, a skip over a
+// jump an extra exit, and FX0A exits back to itself while no key is held.
+//
+// Exits chain straight into the next compiled block through links while the
+// cycle budget covers it, so control only returns to runCycles() for
+// interpreted instructions, wait loops and the end of the budget. Code is
+// written to RW pages that are flipped to RX afterwards, never both at once.
+// On other architectures every instruction is interpreted.
+class Chip8Jit {
+private:
+  using BlockFunction = long long (*)(Chip8 *chip8, long long budget); // Returns the budget left
+
+  struct Block {
+    unsigned short start; // First address covered
+    unsigned short end; // One past the last address covered
+    unsigned int instructionCount; // Instructions executed per call, 0 if nothing could be compiled
+    BlockFunction code;
+  };
+
+  unsigned char *codeBuffer; // Executable memory
+  unsigned long long codeBufferSize;
+  unsigned long long codeBufferUsed;
+
+  std::vector<Block> blocks; // Compiled blocks, indexed through blockAt
+  int blockAt[4096]; // Index into blocks for each start address, -1 if not compiled
+  unsigned short codeBytes[4096]; // Number of blocks covering each address
+
+  // Read by generated code at every exit, 16 bytes per address
+  struct Link {
+    const unsigned char *code; // Entry for chaining, past the budget argument setup
+    long long instructionCount; // Budget needed to enter, LLONG_MAX when the address must go through runCycles()
+  };
+  Link links[4096];
+
+  int compile(const Chip8 &chip8, unsigned short address); // Returns the index of the new block
+  void invalidate(unsigned short address); // Drop blocks covering address
+  void protect(unsigned long long offset, unsigned long long size, bool writable); // Flip code buffer pages between RW and RX
+
+public:
+  Chip8Jit(unsigned long long codeBufferSize = 4 * 1024 * 1024);
+  ~Chip8Jit();
+
+  Chip8Jit(const Chip8Jit &) = delete;
+  Chip8Jit &operator=(const Chip8Jit &) = delete;
+
+  static bool isSupported(); // True if blocks are compiled to native code on this host
+
+  void runCycles(Chip8 &chip8, unsigned long long count); // Execute count instructions
+  void flush(); // Drop all blocks and reuse the code buffer, call after Chip8::restore()
+  void precompile(const Chip8 &chip8, std::span<const unsigned short> starts); // Compile blocks before they run, e.g. Chip8Analyzer::getBlockStarts()
+};
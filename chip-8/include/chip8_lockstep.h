@@ -0,0 +1,108 @@
+#pragma once
+#include <vector>
+
+#include "chip8_random.h"
+
+class Chip8;
+
+// Runs many copies of one ROM side by side, with the machine state stored as
+// struct-of-arrays: register x of every machine is contiguous, and so are pc,
+// index, the timers and so on. Each step picks the lowest pc among the
+// machines that still have cycles left and executes that instruction for
+// every machine sitting at the same pc. Register arithmetic runs across all
+// of those lanes at once (AVX2 when the CPU has it). Instructions that touch
+// per-machine memory, VRAM or PRNG, such as DXYN, FX33 or CXNN, loop over the
+// active lanes one at a time. Machines that diverge simply wait their turn.
+class Chip8Lockstep {
+public:
+  static constexpr unsigned int laneBlock = 32; // Lanes per AVX2 byte vector, lane arrays are padded to this
+
+private:
+  unsigned int machineCount; // Machines requested by the caller
+  unsigned int laneCount; // machineCount rounded up to laneBlock, padding lanes never run
+  bool avx2; // Run the AVX2 kernels, checked once against the CPU
+
+  // Lane-major state: element [i * laneCount + lane]
+  std::vector<unsigned char> v; // Registers
+  std::vector<unsigned short> stack; // Stack
+
+  // One element per lane
+  std::vector<unsigned short> pc; // Program counter
+  std::vector<unsigned short> index; // Index register
+  std::vector<unsigned short> sp; // Stack pointer
+  std::vector<unsigned char> delayTimer; // Delay timer
+  std::vector<unsigned char> soundTimer; // Sound timer
+  std::vector<unsigned short> keys; // Keypad, bit i set means key i is pressed
+  std::vector<unsigned char> enabled; // 0 for lanes parked by the caller or padding
+  std::vector<unsigned long long> cycles; // Number of executed instructions
+  std::vector<Chip8Random> random; // Source for CXNN
+
+  // Machine-major state: element [lane * size + i]
+  std::vector<unsigned char> memory; // 4096 bytes per lane
+  std::vector<unsigned long long> vram; // 32 rows per lane, bit 63 is the leftmost pixel
+  std::vector<unsigned char> written; // Addresses any machine has stored to, only there can code differ
+
+  // Scratch for the current group
+  std::vector<unsigned char> active; // 0xFF for lanes executing the current instruction, 0 otherwise
+  std::vector<unsigned short> remaining; // Cycles left in the current chunk
+  std::vector<unsigned char> scratch; // Flags and skip conditions before they are committed
+
+  unsigned long long groups; // Instructions issued, each covering one or more lanes
+  unsigned long long laneInstructions; // Instructions executed summed over lanes
+
+  unsigned char *reg(unsigned char x) { return &v[(x & 0xF) * laneCount]; }
+  unsigned short fetch(unsigned int lane, unsigned short address) const;
+
+  unsigned short lowestPC() const; // Among lanes with cycles left, 0xFFFF if there are none
+  unsigned int selectLanes(unsigned short address); // Activate and charge the lanes at address, returns how many
+  void advancePC(unsigned int first, unsigned int last); // pc += 2 on the active lanes
+
+  void runChunk(unsigned short count);
+  void runAlone(unsigned int first, unsigned int last); // Continue a group of one without rescanning
+  void execute(unsigned short opcode, unsigned int first, unsigned int last); // Run opcode on the active lanes in [first, last)
+  void drawSprite(unsigned int lane, unsigned char x, unsigned char y, unsigned char n); // DXYN
+
+  template <typename LaneOp>
+  void applyBytes(unsigned char *dst, const unsigned char *a, const unsigned char *b, unsigned int first, unsigned int last);
+  template <typename LaneOp>
+  void applyImmediate(unsigned char *dst, const unsigned char *a, unsigned char immediate, unsigned int first, unsigned int last);
+  void skipIf(const unsigned char *condition, unsigned int first, unsigned int last); // pc += 2 where active and condition is non-zero
+
+public:
+  Chip8Lockstep(const unsigned char *gameBinaryData, unsigned int gameBinaryDataSize, unsigned int machineCount);
+
+  // Execution, applies to every enabled machine
+  void runCycles(unsigned long long count); // Execute count instructions on each machine
+  void tickTimers(); // Decrement delay and sound timers, call at 60 Hz
+
+  // Parked machines neither execute nor tick their timers
+  void setEnabled(unsigned int machine, bool isEnabled) { enabled[machine] = isEnabled ? 1 : 0; }
+  bool isEnabled(unsigned int machine) const { return enabled[machine] != 0; }
+
+  void seedRandom(unsigned int machine, unsigned long long seed) { random[machine].seed(seed); } // Matches Chip8::seedRandom()
+
+  // Input
+  void setKeys(unsigned int machine, unsigned short keyMask) { keys[machine] = keyMask; }
+
+  // Inspection, same meaning as the Chip8 accessors of the same name
+  unsigned int getMachineCount() const { return machineCount; }
+  const unsigned long long *getVRAM(unsigned int machine) const { return &vram[machine * 32]; }
+  unsigned short getPC(unsigned int machine) const { return pc[machine]; }
+  unsigned short getIndex(unsigned int machine) const { return index[machine]; }
+  unsigned short getSP(unsigned int machine) const { return sp[machine]; }
+  unsigned char getRegister(unsigned int machine, unsigned char x) const { return v[(x & 0xF) * laneCount + machine]; }
+  unsigned char getDelayTimer(unsigned int machine) const { return delayTimer[machine]; }
+  unsigned char getSoundTimer(unsigned int machine) const { return soundTimer[machine]; }
+  unsigned char peekMemory(unsigned int machine, unsigned short address) const { return memory[machine * 4096 + (address & 0xFFF)]; }
+  unsigned long long getCycles(unsigned int machine) const { return cycles[machine]; }
+  bool isHalted(unsigned int machine) const; // True if the instruction at pc jumps to itself
+
+  // Copies the complete state of one machine into chip8, which then continues
+  // exactly where the machine stopped. Lets a caller move machines that no
+  // longer share their instructions to scalar execution.
+  void exportMachine(unsigned int machine, Chip8 &chip8) const;
+
+  // Average number of machines sharing each issued instruction
+  double getOccupancy() const { return groups ? (double)laneInstructions / groups : 0.0; }
+  void resetOccupancy() { groups = 0; laneInstructions = 0; } // Start a new measuring window
+};
@@ -0,0 +1,71 @@
+#pragma once
+#include <stdio.h>
+#include <vector>
+
+// Counts executions per address and per instruction kind, and attributes
+// them to the current CHIP-8 call stack (2NNN pushes, 00EE pops). Attach it
+// with Chip8::runObserved(), which is the only loop that calls it.
+class Chip8Profiler {
+public:
+  static constexpr int maxDepth = 64; // Calls deeper than this are charged to the deepest frame
+
+private:
+  // Call tree, one node per distinct stack of subroutine entry addresses
+  struct Node {
+    int parent; // -1 for the root
+    unsigned short address; // Subroutine entry, 0x200 for the root
+    unsigned long long count; // Instructions executed with this node on top
+    std::vector<int> children;
+  };
+
+  unsigned long long addressCounts[4096];
+  unsigned short addressOpcodes[4096]; // Last opcode seen at each address, for the report
+  unsigned long long kindCounts[36]; // Indexed by kindOf()
+  unsigned long long total;
+
+  std::vector<Node> nodes;
+  int current; // Node on top of the call stack
+  int depth;
+  int maxObservedDepth;
+
+  static int kindOf(unsigned short opcode);
+  static const char *kindName(int kind);
+  int child(int parent, unsigned short address);
+  void writeStack(FILE *out, int node) const;
+  unsigned long long inclusiveCount(int node) const; // Instructions executed in node and everything below it
+
+public:
+  Chip8Profiler();
+
+  void reset();
+
+  inline void onInstruction(unsigned short address, unsigned short opcode) {
+    addressCounts[address]++;
+    addressOpcodes[address] = opcode;
+    kindCounts[kindOf(opcode)]++;
+    nodes[current].count++;
+    total++;
+
+    if ((opcode & 0xF000) == 0x2000) { // Entering a subroutine
+      if (depth < maxDepth) {
+        current = child(current, opcode & 0x0FFF);
+      }
+      depth++;
+      maxObservedDepth = depth > maxObservedDepth ? depth : maxObservedDepth;
+    }
+    else if (opcode == 0x00EE && depth > 0) { // Leaving one
+      if (depth <= maxDepth) {
+        current = nodes[current].parent;
+      }
+      depth--;
+    }
+  }
+
+  unsigned long long getCount(unsigned short address) const { return addressCounts[address & 0xFFF]; }
+  unsigned short getOpcode(unsigned short address) const { return addressOpcodes[address & 0xFFF]; } // Last one executed there
+  unsigned long long getTotal() const { return total; }
+  int getMaxDepth() const { return maxObservedDepth; }
+
+  void writeReport(FILE *out, int topAddresses = 20) const; // Hottest addresses, instruction mix and call depth
+  void writeFoldedStacks(FILE *out) const; // One "0x200;0x2A4;0x31C count" line per stack, for flamegraph.pl and friends
+};
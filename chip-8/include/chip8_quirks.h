@@ -0,0 +1,65 @@
+#pragma once
+
+// Behaviour that differs between CHIP-8 interpreters of different eras, for
+// the second template parameter of Chip8Extended. Every field is a compile
+// time constant, so each profile is its own interpreter with no quirk checks
+// left at runtime.
+
+// How far FX55/FX65 move I
+enum class Chip8IndexAdvance {
+  None, // I is left alone
+  ByX, // I += X, CHIP-48 off-by-one
+  ByXPlusOne // I += X + 1, I ends up past the last register
+};
+
+// COSMAC VIP, the original interpreter
+struct Chip8QuirksVip {
+  static constexpr const char *name = "vip";
+  static constexpr bool logicResetsVF = true; // 8XY1/8XY2/8XY3 clear VF
+  static constexpr Chip8IndexAdvance loadStoreIndex = Chip8IndexAdvance::ByXPlusOne;
+  static constexpr bool shiftUsesVy = true; // 8XY6/8XYE shift Vy into Vx instead of shifting Vx
+  static constexpr bool jumpUsesVx = false; // BXNN jumps to XNN + VX instead of NNN + V0
+  static constexpr bool wrapSprites = false; // Sprites wrap around the edges instead of being clipped
+  static constexpr bool displayWait = true; // DXYN waits for the next 60 Hz tick, at most one draw per frame
+  static constexpr bool countCollidedRows = false; // Hires DXYN sets VF to the number of rows that collided or were clipped
+  static constexpr bool clearOnResolutionChange = false; // 00FE/00FF also clear the screen
+};
+
+// CHIP-48 on the HP-48
+struct Chip8QuirksChip48 {
+  static constexpr const char *name = "chip48";
+  static constexpr bool logicResetsVF = false;
+  static constexpr Chip8IndexAdvance loadStoreIndex = Chip8IndexAdvance::ByX;
+  static constexpr bool shiftUsesVy = false;
+  static constexpr bool jumpUsesVx = true;
+  static constexpr bool wrapSprites = false;
+  static constexpr bool displayWait = false;
+  static constexpr bool countCollidedRows = false;
+  static constexpr bool clearOnResolutionChange = false;
+};
+
+// SUPER-CHIP 1.1
+struct Chip8QuirksSuperChip {
+  static constexpr const char *name = "schip";
+  static constexpr bool logicResetsVF = false;
+  static constexpr Chip8IndexAdvance loadStoreIndex = Chip8IndexAdvance::None;
+  static constexpr bool shiftUsesVy = false;
+  static constexpr bool jumpUsesVx = true;
+  static constexpr bool wrapSprites = false;
+  static constexpr bool displayWait = false;
+  static constexpr bool countCollidedRows = true;
+  static constexpr bool clearOnResolutionChange = false;
+};
+
+// Octo and XO-CHIP, what most ROMs written today expect
+struct Chip8QuirksModern {
+  static constexpr const char *name = "modern";
+  static constexpr bool logicResetsVF = false;
+  static constexpr Chip8IndexAdvance loadStoreIndex = Chip8IndexAdvance::ByXPlusOne;
+  static constexpr bool shiftUsesVy = true;
+  static constexpr bool jumpUsesVx = false;
+  static constexpr bool wrapSprites = true;
+  static constexpr bool displayWait = false;
+  static constexpr bool countCollidedRows = false;
+  static constexpr bool clearOnResolutionChange = true;
+};
@@ -0,0 +1,23 @@
+#pragma once
+
+// xorshift64, the per-machine PRNG behind CXNN. Every engine draws from its
+// own copy so that the same seed always gives the same run.
+struct Chip8Random {
+  unsigned long long state;
+
+  void seed(unsigned long long seed) {
+    // splitmix64, so small or zero seeds still give a well mixed, non-zero state
+    unsigned long long z = seed + 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    z ^= z >> 31;
+    state = z ? z : 1;
+  }
+
+  unsigned char next() {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return (unsigned char)(state >> 32);
+  }
+};
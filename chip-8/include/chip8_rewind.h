@@ -0,0 +1,50 @@
+#pragma once
+#include <vector>
+
+#include "chip8.h"
+
+// Time travel for a Chip8 driven one frame at a time. A keyframe (snapshot)
+// is taken every keyframeInterval frames and the key mask of every frame is
+// logged, so going back re-simulates from the nearest earlier keyframe
+// instead of storing the state of every frame.
+//
+// Keyframes come in groups: the first of a group is a full snapshot and the
+// rest are deltas against it. The ring holds groupCount groups and drops the
+// oldest group as a whole, so memory use is fixed by the constructor
+// arguments.
+class Chip8Rewind {
+private:
+  struct Group {
+    unsigned long long firstFrame; // Frame of the full snapshot
+    std::vector<unsigned char> base; // Full snapshot at firstFrame
+    std::vector<std::vector<unsigned char>> deltas; // Keyframe i + 1 of the group, against base
+    unsigned int deltaCount; // Deltas in use, the vectors are kept around for reuse
+  };
+
+  Chip8 &chip8;
+  unsigned long long cyclesPerFrame;
+  unsigned int keyframeInterval; // Frames between keyframes
+  unsigned int keyframesPerGroup; // One full snapshot plus keyframesPerGroup - 1 deltas
+
+  std::vector<Group> groups; // Ring, oldest at groupHead
+  unsigned int groupHead;
+  unsigned int groupCount;
+
+  std::vector<unsigned short> keyLog; // Key mask of frame f at keyLog[f % keyLog.size()]
+
+  unsigned long long frame; // Frames run so far, including replays
+
+  Group &groupAt(unsigned int i) { return groups[(groupHead + i) % groups.size()]; }
+  unsigned long long framesPerGroup() const { return (unsigned long long)keyframeInterval * keyframesPerGroup; }
+  void recordKeyframe();
+
+public:
+  Chip8Rewind(Chip8 &chip8, unsigned long long cyclesPerFrame, unsigned int keyframeInterval = 30, unsigned int keyframesPerGroup = 8, unsigned int groupCount = 16);
+
+  void runFrame(unsigned short keyMask); // Set keys, run one frame worth of cycles and tick the timers
+  bool rewind(unsigned long long frames); // Go back in time, false and nothing changed if that is past the recorded history
+
+  unsigned long long getFrame() const { return frame; }
+  unsigned long long getOldestFrame() const; // Furthest back rewind() can go
+  unsigned long long getMemoryUsage() const; // Bytes held by keyframes and the key log
+};
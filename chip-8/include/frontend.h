@@ -0,0 +1,95 @@
+#pragma once
+#include <atomic>
+#include <type_traits>
+
+#include "audio_device.h"
+#include "beeper.h"
+#include "chip8.h"
+#include "chip8_input_trace.h"
+#include "chip8_rewind.h"
+#include "renderer.h"
+#include "triple_buffer.h"
+
+struct GLFWwindow;
+
+// Runs a Chip8, or a Chip8Extended for other modes and quirk profiles, in a
+// window. The CPU, timers, rewind and sound live on an emulation thread with
+// its own 60 Hz clock; the main thread polls input, uploads and presents.
+// Finished frames cross over in a triple buffer and keys in an atomic mask,
+// so a slow swap never delays emulation.
+//
+// Instantiated for Chip8 and every Chip8Extended in frontend.cpp.
+template <typename Machine = Chip8>
+class Frontend {
+private:
+  static constexpr unsigned int sampleRate = 48000;
+  static constexpr int turboPresentInterval = 10; // Frames published while in turbo, one in this many
+
+  // Rewind, dirty rows and sound edges only exist on Chip8. Chip8Extended has
+  // a 128x64 framebuffer per plane and its tone changes once per frame.
+  static constexpr bool classic = std::is_same_v<Machine, Chip8>;
+  static constexpr int displayRows = classic ? 32 : 64;
+
+  // Stands in for Chip8Rewind on machines without snapshots: runs frames, never goes back
+  struct Forward {
+    Machine &chip8;
+    int cyclesPerFrame;
+
+    void runFrame(unsigned short keyMask) {
+      chip8.setKeys(keyMask);
+      chip8.runCycles(cyclesPerFrame);
+      chip8.tickTimers();
+    }
+    bool rewind(unsigned long long) { return false; }
+  };
+
+  // What the emulation thread publishes after every tick
+  struct Frame {
+    unsigned long long vram[2 * 64 * 2]; // Chip8::getVRAM() rows, or every Chip8Extended plane
+    unsigned long long generation; // Bumped whenever vram changed
+    unsigned long long rowGenerations[64]; // generation at which each row last changed
+    int delayTimer;
+    int soundTimer;
+    bool turbo;
+  };
+
+  // -- Emulation thread, or the main thread while it is not running --
+  Machine &chip8;
+  int scale; // Display scale
+  int cyclesPerFrame; // CPU cycles executed per 60 Hz tick
+  std::conditional_t<classic, Chip8Rewind, Forward> rewind; // Hold backspace to run time backwards
+  Chip8InputTrace *recording; // Receives every key change when not null
+  Beeper beeper; // Fed sound edges after every frame
+  AudioDevice audio; // Plays the beeper, silent if no device could be opened
+  unsigned long long vramGeneration; // Display changes published so far
+  unsigned long long rowGenerations[64]; // vramGeneration at each row's last change
+
+  // -- Shared --
+  TripleBuffer<Frame> frames;
+  std::atomic<unsigned short> keys; // Keypad state as a Chip8::setKeys() mask
+  std::atomic<bool> rewinding; // Backspace held
+  std::atomic<bool> turbo; // Toggled with tab: frames back to back, timers still tick once per frame
+  std::atomic<bool> running;
+
+  // -- Main thread --
+  GLFWwindow *window;
+  Renderer renderer;
+  float phosphor; // Renderer persistence, 0 for a plain display
+
+  unsigned short readKeys(); // Keypad state as a Chip8::setKeys() mask
+  void pushSound(); // Hands the frame's sound edges to the beeper
+  void clearSound(); // Drops the frame's sound edges
+  void publishFrame(); // Copies the display and timers into the triple buffer
+  void uploadFrame(const Frame &frame, unsigned long long rows); // Bit y set for each row to upload
+  void emulate(); // Emulation thread body
+
+public:
+  Frontend(Machine &chip8, int cyclesPerFrame = 1000, Chip8InputTrace *recording = nullptr, int scale = 10)
+      : chip8(chip8), scale(scale), cyclesPerFrame(cyclesPerFrame), rewind(chip8, cyclesPerFrame), recording(recording),
+        beeper(sampleRate, cyclesPerFrame * 60.0), audio(beeper), vramGeneration(0), rowGenerations(),
+        keys(0), rewinding(false), turbo(false), running(false), window(nullptr), phosphor(0.0F) {}
+
+  void setPhosphor(float persistence) { phosphor = persistence; } // Before run(), see Renderer::setPersistence()
+
+  int run();
+};
@@ -0,0 +1,47 @@
+#pragma once
+
+// Draws CHIP-8 VRAM as a single textured quad. VRAM is uploaded to a GL_R8
+// texture, 64x32 for Chip8 or 128x64 for Chip8Extended, and the fragment
+// shader scales it to the window, so the cost of a frame does not depend on
+// how many pixels are lit.
+//
+// With phosphor persistence on, each draw first runs a texture-sized pass that
+// blends the VRAM texture into an accumulation texture, keeping the brighter
+// of the new pixel and the previous value times the persistence. The quad
+// then shows the accumulation instead, so sprites that XOR off and on again
+// between frames glow rather than flicker.
+class Renderer {
+private:
+  unsigned int shaderProgram;
+  unsigned int decayProgram; // Accumulation pass
+  unsigned int vao;
+  unsigned int vbo;
+  unsigned int vramTexture;
+  unsigned int accumTextures[2]; // Ping-pong pair, GL_R16F so faint glow decays all the way to black
+  unsigned int accumFramebuffers[2];
+  int accumCurrent; // Index of the accumulation texture holding the last draw
+
+  float persistence; // 0 when phosphor decay is off
+  int persistenceUniform;
+  int fadeLength; // Draws for a lit pixel to fade below what an 8-bit display shows
+  int fadeFrames; // Draws left until the glow is too faint to see
+
+  int width; // Texture size in pixels, set by setup()
+  int height;
+  unsigned char pixels[128 * 64]; // One byte per pixel, staging for the texture upload
+
+  void clearAccumulation();
+
+public:
+  void setup(int width = 64, int height = 32); // Requires a current OpenGL 3.3 context, 128x64 for Chip8Extended
+  void teardown();
+
+  // Brightness a pixel keeps per draw once it goes dark, 0 to 1. 0 turns the
+  // accumulation pass off.
+  void setPersistence(float persistence);
+  bool isFading() const { return fadeFrames > 0; } // Another draw would still change the picture
+
+  void upload(const unsigned long long *vram, unsigned int rows = 0xFFFFFFFF); // 32 rows as returned by Chip8::getVRAM(), only those with their bit set in rows
+  void uploadPlanes(const unsigned long long *planes, int planeCount); // 128x64, planeCount framebuffers as returned by Chip8Extended::getPlane()
+  void draw();
+};
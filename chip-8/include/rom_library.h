@@ -0,0 +1,66 @@
+#pragma once
+#include <span>
+#include <string>
+#include <vector>
+#include <memory>
+
+// A read-only file mapped into memory. The bytes stay valid, and are never
+// copied, for as long as the MappedFile lives.
+class MappedFile {
+private:
+  const unsigned char *data;
+  size_t size;
+#if defined(_WIN32)
+  void *file;
+  void *mapping;
+#else
+  int file;
+#endif
+
+public:
+  MappedFile();
+  ~MappedFile();
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  bool open(const char *path); // False if the file cannot be opened or mapped
+  void close();
+
+  std::span<const unsigned char> bytes() const { return { data, size }; }
+};
+
+// A set of ROMs backed by mapped files, either every .ch8 in a directory or
+// one packed archive. Roms point straight into the mappings, so thousands of
+// them cost no heap copies, and each one's content hash is computed once
+// when the library is opened.
+//
+// Archive layout, little-endian: 'C' '8' 'P' 'K', u8 version, u32 ROM
+// count, then one index entry per ROM (u32 data offset from the start of the
+// file, u32 size, u16 name length, name bytes), then the ROM data.
+class RomLibrary {
+public:
+  struct Rom {
+    std::string name; // File name, or the name stored in the archive
+    std::span<const unsigned char> data; // Points into a mapping owned by the library
+    unsigned long long hash; // FNV-1a of data, a cache key for decoded or compiled code
+  };
+
+private:
+  std::vector<std::unique_ptr<MappedFile>> files;
+  std::vector<Rom> roms; // Sorted by name
+
+  void addRom(std::unique_ptr<MappedFile> file, const std::string &name); // The whole file is one ROM
+  bool addArchive(std::unique_ptr<MappedFile> file);
+
+public:
+  bool openDirectory(const char *path); // Adds every .ch8 file, false if the directory cannot be read
+  bool openArchive(const char *path); // False, and nothing added, if path is not a valid archive
+  bool openFile(const char *path); // Adds a single ROM
+  bool open(const char *path); // A directory, an archive or a single ROM, depending on what path is
+
+  const std::vector<Rom> &getRoms() const { return roms; }
+
+  bool writeArchive(const char *path) const; // Packs every ROM into one archive for openArchive()
+
+  static unsigned long long hashContent(std::span<const unsigned char> data);
+};
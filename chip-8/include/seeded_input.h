@@ -0,0 +1,35 @@
+#pragma once
+
+// Scripted input derived from a seed, shared by chip8-batch and chip8-bench.
+// Seed 0 never presses anything, any other seed holds a random key (or none)
+// for a random number of frames.
+class SeededInput {
+private:
+  unsigned long long state;
+  unsigned short keys;
+  int framesLeft;
+
+  unsigned long long next() {
+    // xorshift64
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+  }
+
+public:
+  SeededInput(unsigned long long seed) : state(seed * 0x9E3779B97F4A7C15ULL), keys(0), framesLeft(0) {}
+
+  unsigned short nextFrame() {
+    if (state == 0) {
+      return 0;
+    }
+
+    if (framesLeft-- <= 0) {
+      unsigned long long r = next();
+      keys = (r & 3) == 0 ? 0 : (unsigned short)(1 << ((r >> 2) & 0xF));
+      framesLeft = 1 + (int)((r >> 8) % 30);
+    }
+    return keys;
+  }
+};
@@ -0,0 +1,46 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+
+// Fixed-size queue for exactly one producer thread and one consumer thread.
+// Neither side ever blocks or takes a lock: push() fails when the ring is
+// full and pop() fails when it is empty. Capacity must be a power of two.
+template <typename T, size_t Capacity>
+class SpscRing {
+  static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+private:
+  T slots[Capacity];
+
+  // Free-running counters, each written by one side only and kept on its own
+  // cache line so the two threads do not fight over it
+  alignas(64) std::atomic<size_t> head; // Next slot to read, written by the consumer
+  alignas(64) std::atomic<size_t> tail; // Next slot to write, written by the producer
+
+public:
+  SpscRing() : head(0), tail(0) {}
+
+  // Producer side
+  bool push(const T &value) {
+    size_t write = tail.load(std::memory_order_relaxed);
+    if (write - head.load(std::memory_order_acquire) == Capacity) {
+      return false;
+    }
+    slots[write & (Capacity - 1)] = value;
+    tail.store(write + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer side
+  bool pop(T &value) {
+    size_t read = head.load(std::memory_order_relaxed);
+    if (read == tail.load(std::memory_order_acquire)) {
+      return false;
+    }
+    value = slots[read & (Capacity - 1)];
+    head.store(read + 1, std::memory_order_release);
+    return true;
+  }
+
+  size_t size() const { return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire); } // Approximate while both sides run
+};
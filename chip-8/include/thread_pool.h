@@ -0,0 +1,48 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed size work-stealing pool. Every worker owns a deque: it pops its own
+// work from the back and, when empty, steals from the front of the others.
+// Tasks are spread round-robin on submit, so stealing only kicks in once the
+// runs start finishing at different times.
+class ThreadPool {
+private:
+  struct WorkQueue {
+    std::mutex mutex;
+    std::deque<std::function<void()>> tasks;
+  };
+
+  std::vector<std::unique_ptr<WorkQueue>> queues; // One per worker
+  std::vector<std::thread> threads;
+
+  std::mutex stateMutex;
+  std::condition_variable workAvailable;
+  std::condition_variable allDone;
+  unsigned long long queued;  // Tasks sitting in a queue, guarded by stateMutex
+  unsigned long long pending; // Tasks submitted but not finished, guarded by stateMutex
+  unsigned int nextQueue;     // Round-robin submit target
+  bool stopping;
+
+  bool popLocal(unsigned int worker, std::function<void()> &task);
+  bool steal(unsigned int worker, std::function<void()> &task);
+  void workerLoop(unsigned int worker);
+
+public:
+  explicit ThreadPool(unsigned int threadCount = 0); // 0 means one per hardware thread
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  void submit(std::function<void()> task);
+  void wait(); // Block until every submitted task has finished
+
+  unsigned int size() const { return (unsigned int)threads.size(); }
+};
@@ -0,0 +1,38 @@
+#pragma once
+#include <atomic>
+
+// Hands the latest value of T from one producer thread to one consumer
+// thread without either side waiting. The producer fills back() and
+// publish()es it; the consumer acquire()s and reads front(). Three slots
+// mean each side always owns one, and the third holds the newest published
+// value until the consumer takes it. Values the consumer was too slow to
+// see are simply replaced.
+template <typename T>
+class TripleBuffer {
+private:
+  static constexpr unsigned int freshBit = 4; // Set in middle when it holds an unread value
+
+  T slots[3];
+  alignas(64) std::atomic<unsigned int> middle; // Slot index, plus freshBit
+  alignas(64) unsigned int backIndex; // Producer only
+  alignas(64) unsigned int frontIndex; // Consumer only
+
+public:
+  TripleBuffer() : slots(), middle(1), backIndex(0), frontIndex(2) {}
+
+  // Producer side
+  T &back() { return slots[backIndex]; }
+  void publish() {
+    backIndex = middle.exchange(backIndex | freshBit, std::memory_order_acq_rel) & ~freshBit;
+  }
+
+  // Consumer side. False, and front() unchanged, when nothing new was published.
+  bool acquire() {
+    if (!(middle.load(std::memory_order_relaxed) & freshBit)) {
+      return false;
+    }
+    frontIndex = middle.exchange(frontIndex, std::memory_order_acq_rel) & ~freshBit;
+    return true;
+  }
+  const T &front() const { return slots[frontIndex]; }
+};
@@ -0,0 +1,21 @@
+#pragma once
+#include <stdio.h>
+
+// Writes mono 16-bit PCM .wav files, the sample count in the header is
+// filled in by close()
+class WavWriter {
+private:
+  FILE *file;
+  unsigned int sampleRate;
+  unsigned long long samples;
+
+public:
+  WavWriter() : file(nullptr), sampleRate(0), samples(0) {}
+  ~WavWriter() { close(); }
+  WavWriter(const WavWriter &) = delete;
+  WavWriter &operator=(const WavWriter &) = delete;
+
+  bool open(const char *path, unsigned int sampleRate);
+  void write(const float *data, unsigned int count); // Samples in [-1, 1], clamped
+  bool close(); // False if anything failed to write
+};
@@ -0,0 +1,83 @@
+#include <vector>
+#include <stdio.h>
+#include <string.h>
+
+#include "chip8.h"
+#include "chip8_analyzer.h"
+#include "rom_library.h"
+
+// Writes to path, or to stdout when path is "-"
+static bool writeTo(const char *path, const Chip8Analyzer &analyzer, void (Chip8Analyzer::*write)(FILE *) const) {
+  if (strcmp(path, "-") == 0) {
+    (analyzer.*write)(stdout);
+    return true;
+  }
+
+  FILE *out = fopen(path, "w");
+  if (!out) {
+    fprintf(stderr, "Could not write %s\n", path);
+    return false;
+  }
+  (analyzer.*write)(out);
+  fclose(out);
+  return true;
+}
+
+int main(int argc, char **argv) {
+  // Flags may appear anywhere, the rest are the positional arguments
+  std::vector<const char *> positional;
+  const char *dotPath = NULL;
+  const char *jsonPath = NULL;
+  bool listing = true;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--dot") == 0 && i + 1 < argc) {
+      dotPath = argv[++i];
+    }
+    else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+      jsonPath = argv[++i];
+    }
+    else if (strcmp(argv[i], "--no-listing") == 0) {
+      listing = false;
+    }
+    else {
+      positional.push_back(argv[i]);
+    }
+  }
+
+  if (positional.size() != 1) {
+    fprintf(stderr, "Usage: %s <rom> [--dot path|-] [--json path|-] [--no-listing]\n", argv[0]);
+    return 1;
+  }
+
+  MappedFile rom;
+  if (!rom.open(positional[0])) {
+    fprintf(stderr, "Could not open %s\n", positional[0]);
+    return 1;
+  }
+  if (rom.bytes().size() > Chip8::maxProgramSize) {
+    fprintf(stderr, "%s is too large for CHIP-8 memory\n", positional[0]);
+    return 1;
+  }
+
+  Chip8Analyzer analyzer(rom.bytes());
+
+  if (listing) {
+    analyzer.writeListing(stdout);
+
+    size_t indirect = 0;
+    for (const auto &[start, block] : analyzer.getBlocks()) {
+      indirect += block.indirect ? 1 : 0;
+    }
+    printf("\n; %zu instructions, %zu blocks, %zu subroutines, %zu indirect jumps, %zu findings\n",
+      analyzer.getInstructions().size(), analyzer.getBlocks().size(), analyzer.getSubroutines().size(), indirect, analyzer.getFindings().size());
+  }
+
+  if (dotPath && !writeTo(dotPath, analyzer, &Chip8Analyzer::writeDot)) {
+    return 1;
+  }
+  if (jsonPath && !writeTo(jsonPath, analyzer, &Chip8Analyzer::writeJson)) {
+    return 1;
+  }
+
+  return 0;
+}
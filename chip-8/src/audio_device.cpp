@@ -0,0 +1,60 @@
+#if defined(CHIP8_HAVE_ALSA)
+#include <alsa/asoundlib.h>
+#endif
+
+#include "audio_device.h"
+
+bool AudioDevice::open(unsigned int sampleRate) {
+  close();
+
+#if defined(CHIP8_HAVE_ALSA)
+  snd_pcm_t *pcm;
+  if (snd_pcm_open(&pcm, "default", SND_PCM_STREAM_PLAYBACK, 0) < 0) {
+    return false;
+  }
+
+  // 5 ms of device buffering plus the beeper's half frame stays under a frame
+  if (snd_pcm_set_params(pcm, SND_PCM_FORMAT_FLOAT_LE, SND_PCM_ACCESS_RW_INTERLEAVED, 1, sampleRate, 1, 5000) < 0) {
+    snd_pcm_close(pcm);
+    return false;
+  }
+
+  handle = pcm;
+  running = true;
+  thread = std::thread(&AudioDevice::run, this);
+  return true;
+#else
+  return false;
+#endif
+}
+
+void AudioDevice::close() {
+  running = false;
+  if (thread.joinable()) {
+    thread.join();
+  }
+
+#if defined(CHIP8_HAVE_ALSA)
+  if (handle) {
+    snd_pcm_drop((snd_pcm_t *)handle);
+    snd_pcm_close((snd_pcm_t *)handle);
+  }
+#endif
+  handle = nullptr;
+}
+
+void AudioDevice::run() {
+  float block[blockFrames];
+
+  while (running) {
+    beeper.render(block, blockFrames);
+
+#if defined(CHIP8_HAVE_ALSA)
+    // Blocks until the device has room, which is what paces this thread
+    snd_pcm_sframes_t written = snd_pcm_writei((snd_pcm_t *)handle, block, blockFrames);
+    if (written < 0) {
+      snd_pcm_recover((snd_pcm_t *)handle, (int)written, 1);
+    }
+#endif
+  }
+}
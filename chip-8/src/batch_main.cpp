@@ -0,0 +1,288 @@
+#include <vector>
+#include <string>
+#include <chrono>
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chip8.h"
+#include "chip8_lockstep.h"
+#include "rom_library.h"
+#include "seeded_input.h"
+#include "thread_pool.h"
+
+#ifndef CHIP8_PROGRAMS_DIR
+#define CHIP8_PROGRAMS_DIR "programs"
+#endif
+
+// One ROM/seed combination, the seed drives both the input and CXNN
+struct BatchRun {
+  const RomLibrary::Rom *rom; // Mapped, shared by every run of the same ROM
+  unsigned long long seed;
+
+  // Results, written by the worker that ran it
+  unsigned long long cycles;
+  unsigned long long registerHash;
+  unsigned long long vramHash;
+  bool halted;
+};
+
+// FNV-1a, same constants as chip8-bench
+struct Fnv1a {
+  unsigned long long hash = 14695981039346656037ULL;
+
+  void mix(unsigned int value) {
+    hash ^= value;
+    hash *= 1099511628211ULL;
+  }
+};
+
+// Works on Chip8 and on a Chip8Lockstep machine, through the same accessor names
+template <typename Machine>
+static unsigned long long hashRegisters(const Machine &machine) {
+  Fnv1a fnv;
+  for (int i = 0; i < 16; i++) {
+    fnv.mix(machine.getRegister(i));
+  }
+  fnv.mix(machine.getPC());
+  fnv.mix(machine.getIndex());
+  fnv.mix(machine.getSP());
+  fnv.mix(machine.getDelayTimer());
+  fnv.mix(machine.getSoundTimer());
+  return fnv.hash;
+}
+
+static unsigned long long hashVRAM(const unsigned long long *vram) {
+  Fnv1a fnv;
+  for (int y = 0; y < 32; y++) {
+    fnv.mix((unsigned int)vram[y]);
+    fnv.mix((unsigned int)(vram[y] >> 32));
+  }
+  return fnv.hash;
+}
+
+// Runs chip8 frame by frame until it halts or reaches maxCycles, and records the result
+static void finishRun(BatchRun &run, Chip8 &chip8, SeededInput &input, unsigned long long maxCycles, unsigned long long cyclesPerFrame) {
+  // Fast-forwarded wait loops would count as executed instructions
+  chip8.setIdleSkipping(false);
+
+  while (chip8.getCycles() < maxCycles && !chip8.isHalted()) {
+    chip8.setKeys(input.nextFrame());
+    chip8.runCycles(std::min(cyclesPerFrame, maxCycles - chip8.getCycles()));
+    chip8.tickTimers();
+  }
+
+  run.cycles = chip8.getCycles();
+  run.registerHash = hashRegisters(chip8);
+  run.vramHash = hashVRAM(chip8.getVRAM());
+  run.halted = chip8.isHalted();
+}
+
+static void runOne(BatchRun &run, unsigned long long maxCycles, unsigned long long cyclesPerFrame) {
+  Chip8 chip8(run.rom->data, run.seed);
+  SeededInput input(run.seed);
+  finishRun(run, chip8, input, maxCycles, cyclesPerFrame);
+}
+
+// One machine of a Chip8Lockstep, seen through the Chip8 accessor names
+struct LockstepMachine {
+  const Chip8Lockstep &lockstep;
+  unsigned int machine;
+
+  unsigned char getRegister(unsigned char x) const { return lockstep.getRegister(machine, x); }
+  unsigned short getPC() const { return lockstep.getPC(machine); }
+  unsigned short getIndex() const { return lockstep.getIndex(machine); }
+  unsigned short getSP() const { return lockstep.getSP(machine); }
+  unsigned char getDelayTimer() const { return lockstep.getDelayTimer(machine); }
+  unsigned char getSoundTimer() const { return lockstep.getSoundTimer(machine); }
+};
+
+// Below this many machines per issued instruction a lockstep group is slower
+// than running its machines one by one, see chip8-bench --lockstep
+static constexpr double minOccupancy = 32.0;
+static constexpr unsigned int occupancyWindow = 4; // Frames between occupancy checks
+
+// Runs a group of seeds of the same ROM in lockstep, frame by frame exactly
+// like runOne(). Machines that halt or reach maxCycles are parked. Once the
+// machines stop sharing their instructions, the ones still running are
+// handed over to Chip8 and finished like runOne() would.
+static void runLockstep(BatchRun *group, unsigned int count, unsigned long long maxCycles, unsigned long long cyclesPerFrame) {
+  if (count < minOccupancy) {
+    // Could never pay off
+    for (unsigned int i = 0; i < count; i++) {
+      runOne(group[i], maxCycles, cyclesPerFrame);
+    }
+    return;
+  }
+
+  Chip8Lockstep lockstep(group[0].rom->data.data(), (unsigned int)group[0].rom->data.size(), count);
+  std::vector<SeededInput> inputs;
+  for (unsigned int i = 0; i < count; i++) {
+    inputs.emplace_back(group[i].seed);
+    lockstep.seedRandom(i, group[i].seed);
+  }
+
+  for (unsigned int frame = 1; ; frame++) {
+    // Every running machine has executed the same number of cycles
+    unsigned long long executed = 0;
+    bool running = false;
+    for (unsigned int i = 0; i < count; i++) {
+      if (lockstep.isEnabled(i) && (lockstep.getCycles(i) >= maxCycles || lockstep.isHalted(i))) {
+        lockstep.setEnabled(i, false);
+      }
+      if (lockstep.isEnabled(i)) {
+        lockstep.setKeys(i, inputs[i].nextFrame());
+        executed = lockstep.getCycles(i);
+        running = true;
+      }
+    }
+    if (!running) {
+      break;
+    }
+
+    lockstep.runCycles(std::min(cyclesPerFrame, maxCycles - executed));
+    lockstep.tickTimers();
+
+    if (frame % occupancyWindow == 0) {
+      if (lockstep.getOccupancy() < minOccupancy) {
+        break;
+      }
+      lockstep.resetOccupancy();
+    }
+  }
+
+  for (unsigned int i = 0; i < count; i++) {
+    BatchRun &run = group[i];
+    if (lockstep.isEnabled(i)) {
+      Chip8 chip8(run.rom->data, run.seed);
+      lockstep.exportMachine(i, chip8);
+      finishRun(run, chip8, inputs[i], maxCycles, cyclesPerFrame);
+      continue;
+    }
+    run.cycles = lockstep.getCycles(i);
+    run.registerHash = hashRegisters(LockstepMachine { lockstep, i });
+    run.vramHash = hashVRAM(lockstep.getVRAM(i));
+    run.halted = lockstep.isHalted(i);
+  }
+}
+
+// Runs every ROM against a range of seeds on a thread pool and prints
+// the final state hashes of each run, so two builds can be diffed.
+int main(int argc, char **argv) {
+  unsigned long long cycles = 1000000;
+  unsigned long long cyclesPerFrame = 1000;
+  unsigned long long seeds = 16;
+  unsigned int threadCount = 0;
+  unsigned int lanes = 0; // Machines per lockstep group, 0 runs every machine on its own
+  const char *packPath = NULL;
+  RomLibrary library;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--cycles") == 0 && i + 1 < argc) {
+      cycles = strtoull(argv[++i], NULL, 0);
+    }
+    else if (strcmp(argv[i], "--cycles-per-frame") == 0 && i + 1 < argc) {
+      cyclesPerFrame = strtoull(argv[++i], NULL, 0);
+    }
+    else if (strcmp(argv[i], "--seeds") == 0 && i + 1 < argc) {
+      seeds = strtoull(argv[++i], NULL, 0);
+    }
+    else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+      threadCount = (unsigned int)atoi(argv[++i]);
+    }
+    else if (strcmp(argv[i], "--lockstep") == 0 && i + 1 < argc) {
+      lanes = (unsigned int)atoi(argv[++i]);
+    }
+    else if (strcmp(argv[i], "--pack") == 0 && i + 1 < argc) {
+      packPath = argv[++i];
+    }
+    else if (argv[i][0] == '-') {
+      fprintf(stderr, "Usage: %s [--cycles N] [--cycles-per-frame N] [--seeds N] [--threads N] [--lockstep LANES] [--pack archive] [rom, directory or archive...]\n", argv[0]);
+      return 1;
+    }
+    else if (!library.open(argv[i])) {
+      fprintf(stderr, "Could not open %s\n", argv[i]);
+      return 1;
+    }
+  }
+
+  if (cyclesPerFrame == 0) {
+    cyclesPerFrame = 1;
+  }
+
+  // Default to every ROM shipped in chip-8/programs
+  if (library.getRoms().empty()) {
+    library.openDirectory(CHIP8_PROGRAMS_DIR);
+  }
+
+  // --pack only writes the archive, later runs can map it in one go
+  if (packPath) {
+    if (!library.writeArchive(packPath)) {
+      fprintf(stderr, "Could not write %s\n", packPath);
+      return 1;
+    }
+    printf("packed %zu roms into %s\n", library.getRoms().size(), packPath);
+    return 0;
+  }
+
+  // Classic machines only, skip whatever does not fit
+  std::vector<const RomLibrary::Rom *> roms;
+  for (const RomLibrary::Rom &rom : library.getRoms()) {
+    if (rom.data.size() > Chip8::maxProgramSize) {
+      fprintf(stderr, "Skipping %s, %zu bytes is too large\n", rom.name.c_str(), rom.data.size());
+      continue;
+    }
+    roms.push_back(&rom);
+  }
+
+  std::vector<BatchRun> runs;
+  for (const RomLibrary::Rom *rom : roms) {
+    for (unsigned long long seed = 0; seed < seeds; seed++) {
+      runs.push_back({ rom, seed, 0, 0, 0, false });
+    }
+  }
+
+  ThreadPool pool(threadCount);
+
+  auto start = std::chrono::steady_clock::now();
+  if (lanes == 0) {
+    for (BatchRun &run : runs) {
+      pool.submit([&run, cycles, cyclesPerFrame] { runOne(run, cycles, cyclesPerFrame); });
+    }
+  }
+  else {
+    // Runs are grouped by ROM, split each ROM's seeds into groups of at most lanes
+    for (size_t r = 0; r < roms.size(); r++) {
+      for (unsigned long long seed = 0; seed < seeds; seed += lanes) {
+        BatchRun *group = &runs[r * seeds + seed];
+        unsigned int count = (unsigned int)std::min<unsigned long long>(lanes, seeds - seed);
+        pool.submit([group, count, cycles, cyclesPerFrame] { runLockstep(group, count, cycles, cyclesPerFrame); });
+      }
+    }
+  }
+  pool.wait();
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  // Results are printed in submission order, whichever worker ran them
+  printf("%-20s %6s %12s %18s %18s %s\n", "rom", "seed", "cycles", "registers", "vram", "halted");
+  unsigned long long totalCycles = 0;
+  for (const BatchRun &run : runs) {
+    printf("%-20s %6llu %12llu   %016llX   %016llX %s\n",
+      run.rom->name.c_str(),
+      run.seed,
+      run.cycles,
+      run.registerHash,
+      run.vramHash,
+      run.halted ? "yes" : "no");
+    totalCycles += run.cycles;
+  }
+
+  printf("runs: %zu\n", runs.size());
+  printf("threads: %u\n", pool.size());
+  printf("instructions: %llu\n", totalCycles);
+  printf("seconds: %.6f\n", seconds);
+  printf("instructions/second: %.0f\n", seconds > 0 ? totalCycles / seconds : 0.0);
+
+  return 0;
+}
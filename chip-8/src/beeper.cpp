@@ -0,0 +1,71 @@
+#include "beeper.h"
+
+Beeper::Beeper(unsigned int sampleRate, double cyclesPerSecond, double frequency, float volume)
+    : samplesPerCycle(sampleRate / cyclesPerSecond), phaseStep(frequency / sampleRate), volume(volume) {
+  // Half a 60 Hz frame of delay absorbs the emulation running in frame sized
+  // bursts. A frame's edges can sit up to a frame plus that delay ahead of
+  // the audio, anything beyond two frames means the clocks drifted apart.
+  latency = sampleRate / 120;
+  maxLead = sampleRate / 30;
+
+  producerOn = false;
+
+  hasPending = false;
+  anchored = false;
+  offset = 0;
+  position = 0;
+  on = false;
+  phase = 0.0;
+}
+
+bool Beeper::setTone(unsigned long long cycle, bool on) {
+  if (on == producerOn) {
+    return true;
+  }
+  if (!events.push({ (unsigned long long)(cycle * samplesPerCycle), on })) {
+    return false;
+  }
+  producerOn = on;
+  return true;
+}
+
+void Beeper::render(float *out, unsigned int frames) {
+  for (unsigned int i = 0; i < frames; i++) {
+    // Apply every event that is due at this sample
+    while (hasPending || events.pop(pending)) {
+      hasPending = true;
+
+      long long sample = (long long)pending.sample;
+      if (!anchored) {
+        offset = position + latency - sample;
+        anchored = true;
+      }
+
+      long long due = sample + offset;
+      if (due > position + maxLead) {
+        // The emulation got ahead of the audio, catch up
+        offset = position + latency - sample;
+        due = position + latency;
+      }
+      if (due > position) {
+        break;
+      }
+      if (due < position - latency) {
+        // Late or from the past after a rewind, play it now and follow it
+        offset = position - sample;
+      }
+
+      on = pending.on;
+      hasPending = false;
+    }
+
+    float value = 0.0F;
+    if (on) {
+      value = phase < 0.5 ? volume : -volume;
+      phase += phaseStep;
+      phase -= (int)phase;
+    }
+    out[i] = value;
+    position++;
+  }
+}
@@ -0,0 +1,466 @@
+#include <fstream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <filesystem>
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chip8.h"
+#include "chip8_jit.h"
+#include "chip8_profiler.h"
+#include "chip8_analyzer.h"
+#include "chip8_lockstep.h"
+#include "seeded_input.h"
+
+#ifndef CHIP8_PROGRAMS_DIR
+#define CHIP8_PROGRAMS_DIR "programs"
+#endif
+
+struct EngineInfo {
+  const char *name;
+  Chip8Dispatch dispatch;
+  bool jit; // Run through Chip8Jit instead of the interpreter
+  bool analyzed; // Predecode or precompile from Chip8Analyzer before the timed run
+};
+
+static const EngineInfo engines[] = {
+  { "switch", Chip8Dispatch_SWITCH, false, false },
+  { "predecoded", Chip8Dispatch_PREDECODED, false, false },
+  { "table", Chip8Dispatch_TABLE, false, false },
+  { "threaded", Chip8Dispatch_THREADED, false, false },
+  { "threaded+cfg", Chip8Dispatch_THREADED, false, true },
+  { "jit", Chip8Dispatch_PREDECODED, true, false },
+  { "jit+cfg", Chip8Dispatch_PREDECODED, true, true },
+};
+
+// FNV-1a over the observable machine state, used to check that all dispatchers agree
+static unsigned long long hashState(const Chip8 &chip8) {
+  unsigned long long hash = 14695981039346656037ULL;
+  auto mix = [&](unsigned int value) {
+    hash ^= value;
+    hash *= 1099511628211ULL;
+  };
+
+  for (int i = 0; i < 16; i++) {
+    mix(chip8.getRegister(i));
+  }
+  mix(chip8.getPC());
+  mix(chip8.getIndex());
+  mix(chip8.getSP());
+
+  const unsigned long long *vram = chip8.getVRAM();
+  for (int y = 0; y < 32; y++) {
+    mix((unsigned int)vram[y]);
+    mix((unsigned int)(vram[y] >> 32));
+  }
+
+  return hash;
+}
+
+// Two loops that differ only in their first instruction, a 15 row DXYN or a
+// LD. Timing both gives the cost of a draw over a trivial instruction.
+//   0x200: A20C       LD I, 0x20C
+//   0x202: D01F/6200  DRW V0, V1, 15 / LD V2, 0
+//   0x204: 7003       ADD V0, 3 (sprites walk off the edges and wrap)
+//   0x206: 7101       ADD V1, 1
+//   0x208: 1202       JP 0x202
+static const unsigned char drawLoop[] = {
+  0xA2, 0x0C, 0xD0, 0x1F, 0x70, 0x03, 0x71, 0x01, 0x12, 0x02, 0x00, 0x00,
+  0xF0, 0x90, 0xF0, 0x90, 0xF0, 0x81, 0x42, 0x24, 0x18, 0x18, 0x24, 0x42, 0x81, 0xFF, 0xAA
+};
+static const unsigned char loadLoop[] = {
+  0xA2, 0x0C, 0x62, 0x00, 0x70, 0x03, 0x71, 0x01, 0x12, 0x02, 0x00, 0x00,
+  0xF0, 0x90, 0xF0, 0x90, 0xF0, 0x81, 0x42, 0x24, 0x18, 0x18, 0x24, 0x42, 0x81, 0xFF, 0xAA
+};
+
+struct BenchResult {
+  std::string rom;
+  const char *engine;
+  double rate; // Instructions per second, best of the repetitions
+  unsigned long long draws; // DXYN executed during the run
+  unsigned long long hash;
+  bool matches; // Same final state as the switch engine
+};
+
+// Best time of repetitions runs of cycles instructions, fed by the same scripted input
+static double timeRun(const EngineInfo &info, const unsigned char *data, unsigned int size, unsigned long long cycles, unsigned long long cyclesPerFrame, int repetitions, unsigned long long &hash) {
+  double bestSeconds = 0.0;
+  Chip8Analyzer analyzer({ data, size });
+
+  for (int repetition = 0; repetition < repetitions; repetition++) {
+    Chip8 chip8(data, size); // Same default seed every run
+    Chip8Jit jit;
+    SeededInput input(1);
+    // Fast-forwarded wait loops would count as executed instructions
+    chip8.setIdleSkipping(false);
+
+    // Analysis is a one-off per ROM, warming the engine is part of startup; neither is timed
+    if (info.analyzed && info.jit) {
+      jit.precompile(chip8, analyzer.getBlockStarts());
+    }
+    else if (info.analyzed) {
+      chip8.predecode(analyzer.getInstructions());
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned long long executed = 0; executed < cycles; executed += cyclesPerFrame) {
+      unsigned long long frameCycles = std::min(cyclesPerFrame, cycles - executed);
+      chip8.setKeys(input.nextFrame());
+      if (info.jit) {
+        jit.runCycles(chip8, frameCycles);
+      }
+      else {
+        chip8.runCycles(frameCycles, info.dispatch);
+      }
+      chip8.tickTimers();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if (repetition == 0 || seconds < bestSeconds) {
+      bestSeconds = seconds;
+    }
+    hash = hashState(chip8);
+  }
+
+  return bestSeconds;
+}
+
+// Best time of lanes machines, seeded 0 to lanes - 1 like chip8-batch, each
+// running cycles instructions frame by frame. One after another on Chip8, or
+// side by side on one Chip8Lockstep. hash covers every machine.
+static double timeMachines(bool lockstep, const unsigned char *data, unsigned int size, unsigned int lanes, unsigned long long cycles, unsigned long long cyclesPerFrame, int repetitions, unsigned long long &hash, double &occupancy) {
+  double bestSeconds = 0.0;
+
+  for (int repetition = 0; repetition < repetitions; repetition++) {
+    std::vector<SeededInput> inputs;
+    for (unsigned int lane = 0; lane < lanes; lane++) {
+      inputs.emplace_back(lane);
+    }
+    Chip8Lockstep group(data, size, lanes);
+    for (unsigned int lane = 0; lane < lanes; lane++) {
+      group.seedRandom(lane, lane);
+    }
+    hash = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    if (lockstep) {
+      for (unsigned long long executed = 0; executed < cycles; executed += cyclesPerFrame) {
+        for (unsigned int lane = 0; lane < lanes; lane++) {
+          group.setKeys(lane, inputs[lane].nextFrame());
+        }
+        group.runCycles(std::min(cyclesPerFrame, cycles - executed));
+        group.tickTimers();
+      }
+    }
+    else {
+      for (unsigned int lane = 0; lane < lanes; lane++) {
+        Chip8 chip8(data, size, lane);
+        // Fast-forwarded wait loops would count as executed instructions
+        chip8.setIdleSkipping(false);
+        for (unsigned long long executed = 0; executed < cycles; executed += cyclesPerFrame) {
+          chip8.setKeys(inputs[lane].nextFrame());
+          chip8.runCycles(std::min(cyclesPerFrame, cycles - executed));
+          chip8.tickTimers();
+        }
+        hash = hash * 31 + hashState(chip8);
+      }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if (repetition == 0 || seconds < bestSeconds) {
+      bestSeconds = seconds;
+    }
+    for (unsigned int lane = 0; lockstep && lane < lanes; lane++) {
+      Chip8 chip8(data, size);
+      group.exportMachine(lane, chip8);
+      hash = hash * 31 + hashState(chip8);
+    }
+    occupancy = lockstep ? group.getOccupancy() : 1.0;
+  }
+
+  return bestSeconds;
+}
+
+// DXYN executed over the same run as timeRun(), counted outside the timed loops
+static unsigned long long countDraws(const unsigned char *data, unsigned int size, unsigned long long cycles, unsigned long long cyclesPerFrame) {
+  Chip8 chip8(data, size);
+  Chip8Profiler profiler;
+  SeededInput input(1);
+
+  for (unsigned long long executed = 0; executed < cycles; executed += cyclesPerFrame) {
+    chip8.setKeys(input.nextFrame());
+    chip8.runObserved(std::min(cyclesPerFrame, cycles - executed), profiler);
+    chip8.tickTimers();
+  }
+
+  unsigned long long draws = 0;
+  for (unsigned short address = 0; address < 4096; address++) {
+    if ((profiler.getOpcode(address) & 0xF000) == 0xD000) {
+      draws += profiler.getCount(address);
+    }
+  }
+  return draws;
+}
+
+// Pulls "key": value out of one line of a results file. Only meant for files
+// written by writeJson() below, which keeps every result on a single line.
+static bool jsonField(const char *line, const char *key, char *value, size_t valueSize) {
+  char pattern[64];
+  snprintf(pattern, sizeof(pattern), "\"%s\":", key);
+  const char *field = strstr(line, pattern);
+  if (!field) {
+    return false;
+  }
+
+  field += strlen(pattern);
+  while (*field == ' ' || *field == '"') {
+    field++;
+  }
+
+  size_t length = strcspn(field, "\",}");
+  if (length >= valueSize) {
+    return false;
+  }
+  memcpy(value, field, length);
+  value[length] = 0;
+  return true;
+}
+
+static void writeJson(FILE *out, const std::vector<BenchResult> &results, const std::vector<std::pair<const char *, double>> &drawCosts, unsigned long long cycles, unsigned long long cyclesPerFrame, int repetitions) {
+  fprintf(out, "{\n");
+  fprintf(out, "  \"cycles\": %llu,\n", cycles);
+  fprintf(out, "  \"cyclesPerFrame\": %llu,\n", cyclesPerFrame);
+  fprintf(out, "  \"repetitions\": %d,\n", repetitions);
+
+  fprintf(out, "  \"drawCost\": [\n");
+  for (size_t i = 0; i < drawCosts.size(); i++) {
+    fprintf(out, "    { \"engine\": \"%s\", \"nsPerDraw\": %.3f }%s\n", drawCosts[i].first, drawCosts[i].second, i + 1 < drawCosts.size() ? "," : "");
+  }
+  fprintf(out, "  ],\n");
+
+  fprintf(out, "  \"results\": [\n");
+  for (size_t i = 0; i < results.size(); i++) {
+    const BenchResult &result = results[i];
+    fprintf(out, "    { \"rom\": \"%s\", \"engine\": \"%s\", \"instructionsPerSecond\": %.0f, \"nsPerInstruction\": %.3f, \"draws\": %llu, \"hash\": \"%016llx\", \"matches\": %s }%s\n",
+      result.rom.c_str(),
+      result.engine,
+      result.rate,
+      1e9 / result.rate,
+      result.draws,
+      result.hash,
+      result.matches ? "true" : "false",
+      i + 1 < results.size() ? "," : "");
+  }
+  fprintf(out, "  ]\n");
+  fprintf(out, "}\n");
+}
+
+// Prints every result that got slower than the baseline by more than
+// threshold percent, returns whether there was one
+static bool compareBaseline(const char *path, const std::vector<BenchResult> &results, double threshold) {
+  FILE *file = fopen(path, "r");
+  if (!file) {
+    fprintf(stderr, "Could not read baseline %s\n", path);
+    return true;
+  }
+
+  bool regressed = false;
+  int compared = 0;
+  char line[1024];
+
+  printf("\nbaseline %s, threshold %.1f%%\n", path, threshold);
+  while (fgets(line, sizeof(line), file)) {
+    char rom[256], engine[64], rate[64];
+    if (!jsonField(line, "rom", rom, sizeof(rom)) || !jsonField(line, "engine", engine, sizeof(engine)) || !jsonField(line, "instructionsPerSecond", rate, sizeof(rate))) {
+      continue;
+    }
+
+    for (const BenchResult &result : results) {
+      if (result.rom != rom || strcmp(result.engine, engine) != 0) {
+        continue;
+      }
+
+      double baselineRate = strtod(rate, NULL);
+      double change = baselineRate > 0 ? (result.rate / baselineRate - 1.0) * 100.0 : 0.0;
+      compared++;
+
+      if (change < -threshold) {
+        regressed = true;
+        printf("%-20s %-12s %14.0f -> %14.0f %+7.1f%%  REGRESSION\n", rom, engine, baselineRate, result.rate, change);
+      }
+    }
+  }
+  fclose(file);
+
+  printf("%d results compared, %s\n", compared, regressed ? "regressions found" : "no regressions");
+  return regressed;
+}
+
+static std::vector<unsigned char> readFile(const std::filesystem::path &path) {
+  std::ifstream file(path, std::ios::binary);
+  return std::vector<unsigned char>((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+}
+
+// --lockstep mode: aggregate throughput of lanes machines per ROM, scalar
+// against one lockstep group. cycles is split between the machines.
+static int benchLockstep(const std::vector<std::filesystem::path> &roms, unsigned int lanes, unsigned long long cycles, unsigned long long cyclesPerFrame, int repetitions) {
+  unsigned long long machineCycles = std::max(cycles / lanes, cyclesPerFrame);
+  double scalarSeconds = 0.0;
+  double lockstepSeconds = 0.0;
+  bool mismatch = false;
+
+  printf("%u machines, %llu instructions each\n", lanes, machineCycles);
+  printf("%-20s %9s %14s %16s %9s\n", "rom", "occupancy", "scalar instr/s", "lockstep instr/s", "vs scalar");
+
+  for (const auto &rom : roms) {
+    std::vector<unsigned char> gameData = readFile(rom);
+    unsigned long long scalarHash = 0;
+    unsigned long long lockstepHash = 0;
+    double occupancy = 0.0;
+    double scalar = timeMachines(false, gameData.data(), (unsigned int)gameData.size(), lanes, machineCycles, cyclesPerFrame, repetitions, scalarHash, occupancy);
+    double lockstep = timeMachines(true, gameData.data(), (unsigned int)gameData.size(), lanes, machineCycles, cyclesPerFrame, repetitions, lockstepHash, occupancy);
+    scalarSeconds += scalar;
+    lockstepSeconds += lockstep;
+
+    bool matches = scalarHash == lockstepHash;
+    mismatch |= !matches;
+
+    double total = (double)machineCycles * lanes;
+    printf("%-20s %9.2f %14.0f %16.0f %8.2fx%s\n",
+      rom.filename().string().c_str(),
+      occupancy,
+      total / scalar,
+      total / lockstep,
+      scalar / lockstep,
+      matches ? "" : "  STATE MISMATCH");
+  }
+
+  double total = (double)machineCycles * lanes * roms.size();
+  printf("%-20s %9s %14.0f %16.0f %8.2fx\n", "all", "", total / scalarSeconds, total / lockstepSeconds, scalarSeconds / lockstepSeconds);
+
+  return mismatch ? 1 : 0;
+}
+
+int main(int argc, char **argv) {
+  unsigned long long cycles = 5000000;
+  unsigned long long cyclesPerFrame = 1000;
+  int repetitions = 3;
+  const char *jsonPath = NULL;
+  const char *baselinePath = NULL;
+  double threshold = 10.0;
+  unsigned int lanes = 0; // Compare scalar against lockstep groups of this many machines instead
+  std::vector<std::filesystem::path> roms;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--cycles") == 0 && i + 1 < argc) {
+      cycles = strtoull(argv[++i], NULL, 0);
+    }
+    else if (strcmp(argv[i], "--repetitions") == 0 && i + 1 < argc) {
+      repetitions = atoi(argv[++i]);
+    }
+    else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+      jsonPath = argv[++i];
+    }
+    else if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) {
+      baselinePath = argv[++i];
+    }
+    else if (strcmp(argv[i], "--threshold") == 0 && i + 1 < argc) {
+      threshold = atof(argv[++i]);
+    }
+    else if (strcmp(argv[i], "--lockstep") == 0 && i + 1 < argc) {
+      lanes = (unsigned int)atoi(argv[++i]);
+    }
+    else {
+      roms.push_back(argv[i]);
+    }
+  }
+
+  if (cycles == 0 || repetitions < 1) {
+    fprintf(stderr, "Usage: %s [--cycles N] [--repetitions N] [--json out] [--baseline in] [--threshold percent] [--lockstep LANES] [roms...]\n", argv[0]);
+    return 1;
+  }
+
+  // Default to every ROM shipped in chip-8/programs
+  if (roms.empty()) {
+    for (const auto &entry : std::filesystem::directory_iterator(CHIP8_PROGRAMS_DIR)) {
+      if (entry.path().extension() == ".ch8") {
+        roms.push_back(entry.path());
+      }
+    }
+    std::sort(roms.begin(), roms.end());
+  }
+
+  if (lanes > 0) {
+    return benchLockstep(roms, lanes, cycles, cyclesPerFrame, repetitions);
+  }
+
+  // Cost of one DXYN per engine, from the two synthetic loops
+  std::vector<std::pair<const char *, double>> drawCosts;
+  printf("%-12s %12s\n", "engine", "ns/DXYN");
+  for (const EngineInfo &info : engines) {
+    unsigned long long hash;
+    double drawSeconds = timeRun(info, drawLoop, sizeof(drawLoop), cycles, cyclesPerFrame, repetitions, hash);
+    double loadSeconds = timeRun(info, loadLoop, sizeof(loadLoop), cycles, cyclesPerFrame, repetitions, hash);
+
+    // One DXYN (or LD) per four loop instructions, the LD itself is left in as a floor
+    double loops = cycles / 4.0;
+    double nsPerDraw = std::max(0.0, (drawSeconds - loadSeconds) / loops * 1e9) + loadSeconds / cycles * 1e9;
+    drawCosts.push_back({ info.name, nsPerDraw });
+    printf("%-12s %12.2f\n", info.name, nsPerDraw);
+  }
+
+  printf("\n%-20s %-12s %14s %10s %9s %7s\n", "rom", "engine", "instr/s", "ns/instr", "vs switch", "DXYN %");
+
+  std::vector<BenchResult> results;
+  bool mismatch = false;
+
+  for (const auto &rom : roms) {
+    std::vector<unsigned char> gameData = readFile(rom);
+    unsigned long long draws = countDraws(gameData.data(), (unsigned int)gameData.size(), cycles, cyclesPerFrame);
+    double switchRate = 0.0;
+    unsigned long long referenceHash = 0;
+
+    for (size_t engine = 0; engine < sizeof(engines) / sizeof(engines[0]); engine++) {
+      const EngineInfo &info = engines[engine];
+      unsigned long long hash = 0;
+      double rate = cycles / timeRun(info, gameData.data(), (unsigned int)gameData.size(), cycles, cyclesPerFrame, repetitions, hash);
+      if (engine == 0) {
+        switchRate = rate;
+        referenceHash = hash;
+      }
+
+      bool matches = hash == referenceHash;
+      mismatch |= !matches;
+      results.push_back({ rom.filename().string(), info.name, rate, draws, hash, matches });
+
+      // Share of the run spent drawing, estimated from the synthetic cost
+      double drawShare = draws * drawCosts[engine].second * 1e-9 / (cycles / rate) * 100.0;
+
+      printf("%-20s %-12s %14.0f %10.2f %8.2fx %6.1f%%%s\n",
+        rom.filename().string().c_str(),
+        info.name,
+        rate,
+        1e9 / rate,
+        rate / switchRate,
+        std::min(drawShare, 100.0),
+        matches ? "" : "  STATE MISMATCH");
+    }
+  }
+
+  if (jsonPath) {
+    FILE *json = fopen(jsonPath, "w");
+    if (!json) {
+      fprintf(stderr, "Could not write %s\n", jsonPath);
+      return 1;
+    }
+    writeJson(json, results, drawCosts, cycles, cyclesPerFrame, repetitions);
+    fclose(json);
+  }
+
+  bool regressed = baselinePath && compareBaseline(baselinePath, results, threshold);
+
+  return mismatch || regressed ? 1 : 0;
+}
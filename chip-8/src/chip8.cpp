@@ -1,21 +1,247 @@
 #include <cstring>
 #include <cassert>
-#include <glad/gl.h>
-#define GLFW_INCLUDE_NONE
-#include <GLFW/glfw3.h>
 #include <stdlib.h>
-#include <stdio.h>
-#include <format>
+#include <array>
+#include <algorithm>
+#include <utility>
 
 #include "chip8.h"
 
-Chip8::Chip8(const unsigned char *gameBinaryData, unsigned int gameBinaryDataSize) {
+struct Chip8::Ops {
+  static void decode(Chip8 &c, const Instruction &i) {
+    // Slot was never decoded or has been invalidated by a write, decode and execute it
+    unsigned short address = (c.pc - 2) & 0xFFF;
+    unsigned short opcode = (c.memory[address] << 8) | c.memory[(address + 1) & 0xFFF];
+    Instruction &slot = c.decoded[address - 0x200];
+    slot = Chip8::decode(opcode);
+    slot.handler(c, slot);
+  }
+
+  static void nop(Chip8 &c, const Instruction &i) {}
+
+  static void cls(Chip8 &c, const Instruction &i) { // 00E0 - CLS
+    c.clearScreen();
+  }
+
+  static void ret(Chip8 &c, const Instruction &i) { // 00EE - RET
+    c.pc = c.stack[c.sp];
+    c.sp = (c.sp - 1) & 0xF;
+  }
+
+  static void jp(Chip8 &c, const Instruction &i) { // 1NNN - JP addr
+    c.pc = i.nnn;
+  }
+
+  static void call(Chip8 &c, const Instruction &i) { // 2NNN - CALL addr
+    c.sp = (c.sp + 1) & 0xF;
+    c.stack[c.sp] = c.pc;
+    c.pc = i.nnn;
+  }
+
+  static void seByte(Chip8 &c, const Instruction &i) { // 3XNN - SE Vx, byte
+    if (c.v[i.x] == i.nn) {
+      c.pc += 2;
+    }
+  }
+
+  static void sneByte(Chip8 &c, const Instruction &i) { // 4XNN - SNE Vx, byte
+    if (c.v[i.x] != i.nn) {
+      c.pc += 2;
+    }
+  }
+
+  static void seReg(Chip8 &c, const Instruction &i) { // 5XY0 - SE Vx, Vy
+    if (c.v[i.x] == c.v[i.y]) {
+      c.pc += 2;
+    }
+  }
+
+  static void ldByte(Chip8 &c, const Instruction &i) { // 6XNN - LD Vx, byte
+    c.v[i.x] = i.nn;
+  }
+
+  static void addByte(Chip8 &c, const Instruction &i) { // 7XNN - ADD Vx, byte
+    c.v[i.x] += i.nn;
+  }
+
+  static void ldReg(Chip8 &c, const Instruction &i) { // 8XY0 - LD Vx, Vy
+    c.v[i.x] = c.v[i.y];
+  }
+
+  static void orReg(Chip8 &c, const Instruction &i) { // 8XY1 - OR Vx, Vy
+    c.v[i.x] |= c.v[i.y];
+  }
+
+  static void andReg(Chip8 &c, const Instruction &i) { // 8XY2 - AND Vx, Vy
+    c.v[i.x] &= c.v[i.y];
+  }
+
+  static void xorReg(Chip8 &c, const Instruction &i) { // 8XY3 - XOR Vx, Vy
+    c.v[i.x] ^= c.v[i.y];
+  }
+
+  static void addReg(Chip8 &c, const Instruction &i) { // 8XY4 - ADD Vx, Vy
+    c.v[0xF] = (((int)c.v[i.x] + (int)c.v[i.y]) > 255) ? 1 : 0;
+    c.v[i.x] += c.v[i.y];
+  }
+
+  static void subReg(Chip8 &c, const Instruction &i) { // 8XY5 - SUB Vx, Vy
+    c.v[0xF] = (c.v[i.x] > c.v[i.y]) ? 1 : 0;
+    c.v[i.x] -= c.v[i.y];
+  }
+
+  static void shr(Chip8 &c, const Instruction &i) { // 8XY6 - SHR Vx {, Vy}
+    c.v[0xF] = c.v[i.x] & 0x1;
+    c.v[i.x] >>= 1;
+  }
+
+  static void subn(Chip8 &c, const Instruction &i) { // 8XY7 - SUBN Vx, Vy
+    c.v[0xF] = (c.v[i.y] > c.v[i.x]) ? 1 : 0;
+    c.v[i.x] = c.v[i.y] - c.v[i.x];
+  }
+
+  static void shl(Chip8 &c, const Instruction &i) { // 8XYE - SHL Vx {, Vy}
+    c.v[0xF] = (c.v[i.x] & 0x80) >> 7;
+    c.v[i.x] <<= 1;
+  }
+
+  static void sneReg(Chip8 &c, const Instruction &i) { // 9XY0 - SNE Vx, Vy
+    if (c.v[i.x] != c.v[i.y]) {
+      c.pc += 2;
+    }
+  }
+
+  static void ldIndex(Chip8 &c, const Instruction &i) { // ANNN - LD I, addr
+    c.index = i.nnn;
+  }
+
+  static void jpOffset(Chip8 &c, const Instruction &i) { // BNNN - JP V0, addr
+    c.pc = c.v[0] + i.nnn;
+  }
+
+  static void rnd(Chip8 &c, const Instruction &i) { // CXNN - RND Vx, byte
+    c.v[i.x] = c.random.next() & i.nn;
+  }
+
+  static void drw(Chip8 &c, const Instruction &i) { // DXYN - DRW Vx, Vy, nibble
+    c.drawSprite(i.x, i.y, i.n);
+  }
+
+  static void skp(Chip8 &c, const Instruction &i) { // EX9E - SKP Vx
+    if (c.keys[c.v[i.x] & 0xF]) {
+      c.pc += 2;
+    }
+  }
+
+  static void sknp(Chip8 &c, const Instruction &i) { // EXA1 - SKNP Vx
+    if (!c.keys[c.v[i.x] & 0xF]) {
+      c.pc += 2;
+    }
+  }
+
+  static void ldVxDt(Chip8 &c, const Instruction &i) { // FX07 - LD Vx, DT
+    c.v[i.x] = c.delayTimer;
+  }
+
+  static void ldVxKey(Chip8 &c, const Instruction &i) { // FX0A - Get key
+    for (int k = 0; k < 0xF; k++) {
+      if (c.keys[k]) {
+        c.v[i.x] = k;
+        return;
+      }
+    }
+    c.pc -= 2;
+  }
+
+  static void ldDtVx(Chip8 &c, const Instruction &i) { // FX15 - LD DT, Vx
+    c.delayTimer = c.v[i.x];
+  }
+
+  static void ldStVx(Chip8 &c, const Instruction &i) { // FX18 - LD ST, Vx
+    c.setSoundTimer(c.v[i.x]);
+  }
+
+  static void addIndex(Chip8 &c, const Instruction &i) { // FX1E - ADD I, Vx
+    c.index += c.v[i.x];
+    c.v[0xF] = (c.index > 0xFFF) ? 1 : 0;
+  }
+
+  static void ldFont(Chip8 &c, const Instruction &i) { // FX29 - LD F, Vx
+    c.index = 0x50 + (c.v[i.x] * 5);
+  }
+
+  static void ldBcd(Chip8 &c, const Instruction &i) { // FX33 - LD B, Vx
+    unsigned char value = c.v[i.x];
+    c.memory[c.index & 0xFFF] = value / 100;
+    c.memory[(c.index + 1) & 0xFFF] = (value / 10) % 10;
+    c.memory[(c.index + 2) & 0xFFF] = value % 10;
+    for (int k = 0; k < 3; k++) {
+      c.invalidateDecoded(c.index + k);
+    }
+  }
+
+  static void storeRegs(Chip8 &c, const Instruction &i) { // FX55 - LD [I], Vx
+    for (int k = 0; k <= i.x; k++) {
+      c.memory[(c.index + k) & 0xFFF] = c.v[k];
+      c.invalidateDecoded(c.index + k);
+    }
+  }
+
+  static void loadRegs(Chip8 &c, const Instruction &i) { // FX65 - LD Vx, [I]
+    for (int k = 0; k <= i.x; k++) {
+      c.v[k] = c.memory[(c.index + k) & 0xFFF];
+    }
+  }
+
+  // Indexed by Op
+  static constexpr Handler handlers[Op_COUNT] = {
+    decode, nop, cls, ret, jp, call, seByte, sneByte, seReg,
+    ldByte, addByte, ldReg, orReg, andReg, xorReg, addReg,
+    subReg, shr, subn, shl, sneReg, ldIndex, jpOffset, rnd,
+    drw, skp, sknp, ldVxDt, ldVxKey, ldDtVx, ldStVx,
+    addIndex, ldFont, ldBcd, storeRegs, loadRegs
+  };
+
+  // -- Opcode table dispatch --
+  using OpcodeHandler = void (*)(Chip8 &c, unsigned short opcode);
+
+  // Extracts the operands on every call instead of reading them from the cache
+  template <Handler handler>
+  static void fromOpcode(Chip8 &c, unsigned short opcode) {
+    Instruction i;
+    i.x = (opcode & 0x0F00) >> 8;
+    i.y = (opcode & 0x00F0) >> 4;
+    i.n = opcode & 0x000F;
+    i.nn = opcode & 0x00FF;
+    i.nnn = opcode & 0x0FFF;
+    handler(c, i);
+  }
+
+  template <unsigned int... I>
+  static constexpr std::array<OpcodeHandler, Op_COUNT> makeOpcodeHandlers(std::integer_sequence<unsigned int, I...>) {
+    return { fromOpcode<handlers[I]>... };
+  }
+
+  static const std::array<OpcodeHandler, 65536> &opcodeTable() {
+    static const std::array<OpcodeHandler, 65536> table = [] {
+      constexpr std::array<OpcodeHandler, Op_COUNT> opcodeHandlers = makeOpcodeHandlers(std::make_integer_sequence<unsigned int, Op_COUNT>());
+      std::array<OpcodeHandler, 65536> table;
+      for (unsigned int opcode = 0; opcode < 65536; opcode++) {
+        table[opcode] = opcodeHandlers[Chip8::decode(opcode).op];
+      }
+      return table;
+    }();
+    return table;
+  }
+};
+
+Chip8::Chip8(const unsigned char *gameBinaryData, unsigned int gameBinaryDataSize, unsigned long long seed) {
   // -- Initialize VRAM --
   memset(vram, 0, sizeof(vram)); // Clear VRAM
-  vramDirty = true;
+  dirtyRows = allRows;
 
   // -- Initialize memory --
-  assert(gameBinaryDataSize < (4096 - 512)); // Make sure game binary data fits into memory
+  assert(gameBinaryDataSize <= maxProgramSize); // Make sure game binary data fits into memory
 
   // Initialize memory
   std::memset(memory, 0, sizeof(memory));
@@ -61,6 +287,17 @@ Chip8::Chip8(const unsigned char *gameBinaryData, unsigned int gameBinaryDataSiz
   pc = 0x200; // Program counter starts at 0x200
   index = 0; // Reset index register
   memset(v, 0, sizeof(v)); // Clear registers
+
+  cycles = 0;
+
+  random.seed(seed);
+  soundEdgeCount = 0;
+  idleSkipping = true;
+
+  // -- Initialize decoded instruction cache --
+  for (Instruction &instruction : decoded) {
+    instruction = { Ops::decode, Op_DECODE, 0, 0, 0, 0, 0 }; // Decode lazily on first execution
+  }
 }
 
 Chip8::~Chip8() {
@@ -77,439 +314,640 @@ inline unsigned char Chip8::readMemory(unsigned short address) {
   return memory[address];
 }
 
-inline void Chip8::writePixel(unsigned short x, unsigned short y, bool value) {
-  if (x >= 64 || y >= 32 || x < 0 || y < 0) {
+inline void Chip8::drawSprite(unsigned char x, unsigned char y, unsigned char n) {
+  // Writes to VF move a sprite positioned by VF, which a whole row at once cannot follow
+  if (x == 0xF || y == 0xF) {
+    drawSpriteVF(x, y, n);
     return;
   }
 
-  vram[y * 64 + x] = value;
-  vramDirty = true;
+  unsigned short startX = v[x] & 63;
+  unsigned short startY = v[y] & 31;
+  v[0xF] = 0;
+
+  // Each sprite row is one shifted word, pixels past the right or bottom edge are clipped
+  for (int yLine = 0; yLine < n && startY + yLine < 32; yLine++) {
+    unsigned long long row = ((unsigned long long)memory[(index + yLine) & 0xFFF] << 56) >> startX;
+    if (row == 0) {
+      continue;
+    }
+
+    if (vram[startY + yLine] & row) {
+      v[0xF] = 1;
+    }
+    vram[startY + yLine] ^= row;
+    dirtyRows |= 1U << (startY + yLine); // A non-zero row always flips something
+  }
 }
 
-inline bool Chip8::readPixel(unsigned short x, unsigned short y) {
-  if (x >= 64 || y >= 32 || x < 0 || y < 0) {
-    return false;
+void Chip8::drawSpriteVF(unsigned char x, unsigned char y, unsigned char n) {
+  // Coordinates are re-read for every pixel, after VF is cleared and again
+  // after a collision sets it, so the rest of the sprite shifts by one
+  v[0xF] = 0;
+
+  for (int yLine = 0; yLine < n; yLine++) {
+    unsigned char bits = memory[(index + yLine) & 0xFFF];
+    for (int xLine = 0; xLine < 8; xLine++) {
+      if (!(bits & (0x80 >> xLine))) {
+        continue;
+      }
+
+      int px = (v[x] & 63) + xLine;
+      int py = (v[y] & 31) + yLine;
+      if (px < 64 && py < 32 && (vram[py] & (1ULL << (63 - px)))) {
+        v[0xF] = 1;
+      }
+
+      px = (v[x] & 63) + xLine;
+      py = (v[y] & 31) + yLine;
+      if (px < 64 && py < 32) {
+        vram[py] ^= 1ULL << (63 - px);
+        dirtyRows |= 1U << py;
+      }
+    }
   }
+}
 
-  return vram[y * 64 + x];
+inline void Chip8::clearScreen() {
+  // Only rows that had something on them change
+  for (int y = 0; y < 32; y++) {
+    if (vram[y]) {
+      dirtyRows |= 1U << y;
+    }
+  }
+  memset(vram, 0, sizeof(vram));
 }
 
-static void glfwErrorCallback(int error, const char *description)
-{
-  fprintf(stderr, "Error: %s\n", description);
+inline void Chip8::setSoundTimer(unsigned char value) {
+  if ((soundTimer > 0) != (value > 0)) {
+    recordSoundEdge(value > 0);
+  }
+  soundTimer = value;
 }
 
-unsigned int shaderProgram;
-unsigned int vao;
-unsigned int mvpLocation;
-
-void setupPixelDrawing() {
-  // Setup pixel drawing
-  const char *vertexShaderSource = R"(
-    #version 330 core
-    layout (location = 0) in vec2 aPos;
-    uniform mat4 mvp;
-    void main() {
-      gl_Position = mvp * vec4(aPos.x, aPos.y, 0.0, 1.0);
-    }
-  )";
-
-  const char *fragmentShaderSource = R"(
-    #version 330 core
-    out vec4 FragColor;
-    void main() {
-      FragColor = vec4(1.0, 1.0, 1.0, 1.0);
-    }
-  )";
-
-  unsigned int vertexShader = glCreateShader(GL_VERTEX_SHADER);
-  glShaderSource(vertexShader, 1, &vertexShaderSource, NULL);
-  glCompileShader(vertexShader);
-
-  unsigned int fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-  glShaderSource(fragmentShader, 1, &fragmentShaderSource, NULL);
-  glCompileShader(fragmentShader);
-
-  shaderProgram = glCreateProgram();
-  glAttachShader(shaderProgram, vertexShader);
-  glAttachShader(shaderProgram, fragmentShader);
-  glLinkProgram(shaderProgram);
-
-  glDeleteShader(vertexShader);
-  glDeleteShader(fragmentShader);
-
-  // Quad with top left at (0, 0)
-  float vertices[] = {
-    // Triangle 1
-    0.0F, 0.0F,
-    0.0F, 1.0F,
-    1.0F, 0.0F,
-    // Triangle 2
-    0.0F, 1.0F,
-    1.0F, 1.0F,
-    1.0F, 0.0F
-  };
+inline void Chip8::invalidateDecoded(unsigned short address) {
+  // An instruction spans two bytes, so a write also affects the slot before it
+  address &= 0xFFF;
+  unsigned short previous = (address - 1) & 0xFFF;
+
+  if (address >= 0x200) {
+    decoded[address - 0x200].handler = Ops::decode;
+    decoded[address - 0x200].op = Op_DECODE;
+  }
+  if (previous >= 0x200) {
+    decoded[previous - 0x200].handler = Ops::decode;
+    decoded[previous - 0x200].op = Op_DECODE;
+  }
+}
 
-  unsigned int VBO;
-  glGenVertexArrays(1, &vao);
-  glGenBuffers(1, &VBO);
+void Chip8::loadMemory(unsigned short address, const unsigned char *source, unsigned short length) {
+  for (unsigned short i = 0; i < length; i++) {
+    unsigned short target = (address + i) & 0xFFF;
+    if (memory[target] != source[i]) {
+      memory[target] = source[i];
+      invalidateDecoded(target);
+    }
+  }
+}
 
-  glBindVertexArray(vao);
+Chip8::Instruction Chip8::decode(unsigned short opcode) {
+  Instruction instruction;
+  instruction.x = (opcode & 0x0F00) >> 8;
+  instruction.y = (opcode & 0x00F0) >> 4;
+  instruction.n = opcode & 0x000F;
+  instruction.nn = opcode & 0x00FF;
+  instruction.nnn = opcode & 0x0FFF;
+  instruction.op = Op_NOP;
+
+  switch (opcode & 0xF000) {
+  case 0x0000:
+    if (instruction.nnn == 0x0E0) instruction.op = Op_CLS;
+    if (instruction.nnn == 0x0EE) instruction.op = Op_RET;
+    break;
+  case 0x1000: instruction.op = Op_JP; break;
+  case 0x2000: instruction.op = Op_CALL; break;
+  case 0x3000: instruction.op = Op_SE_BYTE; break;
+  case 0x4000: instruction.op = Op_SNE_BYTE; break;
+  case 0x5000: instruction.op = Op_SE_REG; break;
+  case 0x6000: instruction.op = Op_LD_BYTE; break;
+  case 0x7000: instruction.op = Op_ADD_BYTE; break;
+  case 0x8000:
+    switch (instruction.n) {
+    case 0x0: instruction.op = Op_LD_REG; break;
+    case 0x1: instruction.op = Op_OR_REG; break;
+    case 0x2: instruction.op = Op_AND_REG; break;
+    case 0x3: instruction.op = Op_XOR_REG; break;
+    case 0x4: instruction.op = Op_ADD_REG; break;
+    case 0x5: instruction.op = Op_SUB_REG; break;
+    case 0x6: instruction.op = Op_SHR; break;
+    case 0x7: instruction.op = Op_SUBN; break;
+    case 0xE: instruction.op = Op_SHL; break;
+    }
+    break;
+  case 0x9000: instruction.op = Op_SNE_REG; break;
+  case 0xA000: instruction.op = Op_LD_INDEX; break;
+  case 0xB000: instruction.op = Op_JP_OFFSET; break;
+  case 0xC000: instruction.op = Op_RND; break;
+  case 0xD000: instruction.op = Op_DRW; break;
+  case 0xE000:
+    if (instruction.nn == 0x9E) instruction.op = Op_SKP;
+    if (instruction.nn == 0xA1) instruction.op = Op_SKNP;
+    break;
+  case 0xF000:
+    switch (instruction.nn) {
+    case 0x07: instruction.op = Op_LD_VX_DT; break;
+    case 0x0A: instruction.op = Op_LD_VX_KEY; break;
+    case 0x15: instruction.op = Op_LD_DT_VX; break;
+    case 0x18: instruction.op = Op_LD_ST_VX; break;
+    case 0x1E: instruction.op = Op_ADD_INDEX; break;
+    case 0x29: instruction.op = Op_LD_FONT; break;
+    case 0x33: instruction.op = Op_LD_BCD; break;
+    case 0x55: instruction.op = Op_STORE_REGS; break;
+    case 0x65: instruction.op = Op_LOAD_REGS; break;
+    }
+    break;
+  }
 
-  glBindBuffer(GL_ARRAY_BUFFER, VBO);
-  glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+  instruction.handler = Ops::handlers[instruction.op];
+  return instruction;
+}
+
+void Chip8::tickTimers() {
+  if (delayTimer > 0) {
+    delayTimer--;
+  }
+  if (soundTimer > 0) {
+    soundTimer--;
+    if (soundTimer == 0) {
+      recordSoundEdge(false);
+    }
+  }
+}
+
+void Chip8::predecode(std::span<const unsigned short> addresses) {
+  // Decoding reads current memory, exactly what the first execution would
+  // do, so a wrong address costs a slot and never changes behaviour
+  for (unsigned short address : addresses) {
+    if (address < 0x200 || address > 0xFFE) {
+      continue;
+    }
+    Instruction &slot = decoded[address - 0x200];
+    if (slot.op == Op_DECODE) {
+      slot = decode((memory[address] << 8) | memory[address + 1]);
+    }
+  }
+}
 
-  glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void *)0);
-  glEnableVertexAttribArray(0);
+void Chip8::recordSoundEdge(bool on) {
+  if (soundEdgeCount == maxSoundEdges) {
+    soundEdgeCount--; // Nobody is polling, keep the newest state
+  }
+  soundEdges[soundEdgeCount++] = { cycles, on };
+}
 
-  glUseProgram(shaderProgram);
-  mvpLocation = glGetUniformLocation(shaderProgram, "mvp");
+void Chip8::setKey(unsigned char key, bool pressed) {
+  keys[key & 0xF] = pressed;
+}
 
-  glBindBuffer(GL_ARRAY_BUFFER, 0);
-  glBindVertexArray(0);
+void Chip8::setKeys(unsigned short keyMask) {
+  for (int i = 0; i < 16; i++) {
+    keys[i] = (keyMask >> i) & 1;
+  }
 }
 
-void drawPixel(int x, int y, int displayScale, float r, float g, float b) {
-  // Draw pixel
-  glUseProgram(shaderProgram);
-
-  // Set MVP in vertex shader
-  float pixelSizeX = 2.0F / 64.0F;
-  float pixelSizeY = 2.0F / 32.0F;
-  float xTrans = -1.0F + (x * pixelSizeX);
-  float yTrans = 1.0F - (y * pixelSizeY) - pixelSizeY;
-  float mvp[16] = {
-    pixelSizeX, 0.0F, 0.0F, 0.0F,
-    0.0F, pixelSizeY, 0.0F, 0.0F,
-    0.0F, 0.0F, 1.0F, 0.0F,
-    xTrans, yTrans, 0.0F, 1.0F
-  };
+bool Chip8::isHalted() const {
+  unsigned short opcode = (peekMemory(pc) << 8) | peekMemory(pc + 1);
+  return opcode == (0x1000 | pc);
+}
 
-  glUniformMatrix4fv(mvpLocation, 1, GL_FALSE, mvp);
+void Chip8::step() {
+  // A single instruction never covers a whole wait loop iteration worth skipping
+  runDispatch(1, defaultDispatch);
+}
 
-  glBindVertexArray(vao);
-  glDrawArrays(GL_TRIANGLES, 0, 6);
-  glBindVertexArray(0);
+void Chip8::runCycles(unsigned long long count) {
+  runCycles(count, defaultDispatch);
 }
 
-void drawVRAM(const bool *vram, int displayScale) {
-  // Draw VRAM
-  for (int y = 0; y < 32; y++) {
-    for (int x = 0; x < 64; x++) {
-      if (vram[y * 64 + x]) {
-        drawPixel(x, y, displayScale, 1.0F, 1.0F, 1.0F);
+void Chip8::runCycles(unsigned long long count, Chip8Dispatch dispatch) {
+  while (count > 0) {
+    count -= alignIdle(count);
+    count -= skipIdle(count);
+
+    // Short slices so that a wait loop entered mid-batch is caught early
+    unsigned long long slice = idleSkipping ? std::min(count, idleCheckInterval) : count;
+    runDispatch(slice, dispatch);
+    count -= slice;
+  }
+}
+
+void Chip8::runDispatch(unsigned long long count, Chip8Dispatch dispatch) {
+  switch (dispatch) {
+  case Chip8Dispatch_SWITCH:
+    runSwitch(count);
+    break;
+  case Chip8Dispatch_PREDECODED:
+    runPredecoded(count);
+    break;
+  case Chip8Dispatch_TABLE:
+    runTable(count);
+    break;
+  case Chip8Dispatch_THREADED:
+    runThreaded(count);
+    break;
+  }
+}
+
+unsigned int Chip8::idleLoopLength(unsigned short address) const {
+  if (address > 0xFFF) {
+    return 0;
+  }
+  unsigned short opcode = (memory[address] << 8) | memory[(address + 1) & 0xFFF];
+
+  // 1NNN to itself
+  if (opcode == (0x1000 | address)) {
+    return 1;
+  }
+
+  // FX0A with nothing held, it re-executes until the keys change. Key F is
+  // not checked, see Ops::ldVxKey().
+  if ((opcode & 0xF0FF) == 0xF00A) {
+    for (int k = 0; k < 0xF; k++) {
+      if (keys[k]) {
+        return 0;
       }
     }
+    return 1;
   }
-}
 
-void handleKeys(GLFWwindow *window, bool *keys) {
-  // Handle key presses
-  keys[0] = glfwGetKey(window, GLFW_KEY_1) == GLFW_PRESS;
-  keys[1] = glfwGetKey(window, GLFW_KEY_2) == GLFW_PRESS;
-  keys[2] = glfwGetKey(window, GLFW_KEY_3) == GLFW_PRESS;
-  keys[3] = glfwGetKey(window, GLFW_KEY_4) == GLFW_PRESS;
-  keys[4] = glfwGetKey(window, GLFW_KEY_Q) == GLFW_PRESS;
-  keys[5] = glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS;
-  keys[6] = glfwGetKey(window, GLFW_KEY_E) == GLFW_PRESS;
-  keys[7] = glfwGetKey(window, GLFW_KEY_R) == GLFW_PRESS;
-  keys[8] = glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS;
-  keys[9] = glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS;
-  keys[10] = glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS;
-  keys[11] = glfwGetKey(window, GLFW_KEY_F) == GLFW_PRESS;
-  keys[12] = glfwGetKey(window, GLFW_KEY_Z) == GLFW_PRESS;
-  keys[13] = glfwGetKey(window, GLFW_KEY_X) == GLFW_PRESS;
-  keys[14] = glfwGetKey(window, GLFW_KEY_C) == GLFW_PRESS;
-  keys[15] = glfwGetKey(window, GLFW_KEY_V) == GLFW_PRESS;
+  // FX07, then SE VX, NN or SNE VX, NN, then 1NNN back to the FX07, spinning
+  // until DT reaches (or leaves) NN
+  if ((opcode & 0xF0FF) == 0xF007 && address <= 0xFFA) {
+    unsigned short test = (memory[address + 2] << 8) | memory[address + 3];
+    unsigned short jump = (memory[address + 4] << 8) | memory[address + 5];
+    if (jump != (0x1000 | address) || (test & 0x0F00) != (opcode & 0x0F00)) {
+      return 0;
+    }
+    if ((test & 0xF000) == 0x3000 && delayTimer != (test & 0xFF)) {
+      return 3;
+    }
+    if ((test & 0xF000) == 0x4000 && delayTimer == (test & 0xFF)) {
+      return 3;
+    }
+  }
+
+  return 0;
 }
 
-int Chip8::run() {
-  // Display configuration
-  int scale = 10;
+unsigned long long Chip8::alignIdle(unsigned long long count) {
+  if (!idleSkipping || pc > 0xFFF || idleLoopLength(pc) != 0) {
+    return 0;
+  }
 
-  // Display calculated dimensions and stuff
-  int displayWidth = 64 * scale;
-  int displayHeight = 32 * scale;
+  // Part way through an FX07 loop, run the rest of the iteration for real
+  unsigned long long lead = 0;
+  if (pc >= 0x204 && idleLoopLength(pc - 4) == 3) {
+    lead = 1;
+  }
+  else if (pc >= 0x202 && idleLoopLength(pc - 2) == 3) {
+    lead = 2;
+  }
+  if (lead == 0 || count < lead) {
+    return 0;
+  }
 
-  GLFWwindow *window;
-  glfwSetErrorCallback(glfwErrorCallback);
+  runSwitch(lead);
+  return lead;
+}
 
-  if (!glfwInit())
-    return -1;
+unsigned long long Chip8::skipIdle(unsigned long long count) {
+  if (!idleSkipping || pc > 0xFFF) {
+    return 0;
+  }
 
-  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-  glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+  unsigned int length = idleLoopLength(pc);
+  if (length == 0 || count < length) {
+    return 0;
+  }
 
-  window = glfwCreateWindow(displayWidth, displayHeight, "Chip-8 by @dcronqvist", NULL, NULL);
-  if (!window) {
-    glfwTerminate();
+  // Every iteration leaves the same state behind, only FX07 writes anything
+  unsigned short opcode = (memory[pc] << 8) | memory[(pc + 1) & 0xFFF];
+  if ((opcode & 0xF0FF) == 0xF007) {
+    v[(opcode >> 8) & 0xF] = delayTimer;
   }
 
-  // Center window
-  GLFWmonitor *monitor = glfwGetPrimaryMonitor();
-  const GLFWvidmode *mode = glfwGetVideoMode(monitor);
-  int monitorX, monitorY;
-  glfwGetMonitorPos(monitor, &monitorX, &monitorY);
-  int windowWidth, windowHeight;
-  glfwGetWindowSize(window, &windowWidth, &windowHeight);
-  glfwSetWindowPos(window, monitorX + (mode->width - windowWidth) / 2, monitorY + (mode->height - windowHeight) / 2);
+  unsigned long long skipped = count - count % length;
+  cycles += skipped;
+  return skipped;
+}
 
-  // Initialize OpenGL
-  glfwMakeContextCurrent(window);
-  gladLoadGL(glfwGetProcAddress);
-  glfwSwapInterval(1);
+void Chip8::runSwitch(unsigned long long count) {
+  for (unsigned long long i = 0; i < count; i++) {
+    stepUncached();
+  }
+}
 
-  float totalTime = 0.0F;
-  float deltaTime = 0.0F;
-  float lastTime = 0.0F;
-  float timerLastDecrement = 0.0F;
+void Chip8::runPredecoded(unsigned long long count) {
+  for (unsigned long long i = 0; i < count; i++) {
+    unsigned short address = pc & 0xFFF;
+    if (address < 0x200) {
+      stepUncached();
+      continue;
+    }
 
-  glViewport(0, 0, displayWidth, displayHeight);
+    // Dispatch straight to the predecoded handler
+    const Instruction &instruction = decoded[address - 0x200];
+    pc += 2;
+    instruction.handler(*this, instruction);
 
-  setupPixelDrawing();
+    cycles++;
+  }
+}
+
+void Chip8::runTable(unsigned long long count) {
+  const std::array<Ops::OpcodeHandler, 65536> &table = Ops::opcodeTable();
+
+  for (unsigned long long i = 0; i < count; i++) {
+    unsigned short opcode = (memory[pc & 0xFFF] << 8) | memory[(pc + 1) & 0xFFF];
+    pc += 2;
+    table[opcode](*this, opcode);
 
-  int targetCyclesPerSecond = 60000;
-  float targetCycleTime = 1.0F / targetCyclesPerSecond;
+    cycles++;
+  }
+}
 
-  while (!glfwWindowShouldClose(window)) {
-    if (vramDirty) {
-      glClearColor(0.0F, 0.0F, 0.0F, 1.0F);
-      glClear(GL_COLOR_BUFFER_BIT);
+void Chip8::runThreaded(unsigned long long count) {
+#if defined(__GNUC__)
+  // Each handler ends in its own indirect jump, giving the branch predictor
+  // one site per instruction kind instead of a single shared dispatch point.
+  // Labels must be listed in Op order.
+  static void *const labels[Op_COUNT] = {
+    &&op_decode, &&op_nop, &&op_cls, &&op_ret, &&op_jp, &&op_call, &&op_seByte, &&op_sneByte, &&op_seReg,
+    &&op_ldByte, &&op_addByte, &&op_ldReg, &&op_orReg, &&op_andReg, &&op_xorReg, &&op_addReg,
+    &&op_subReg, &&op_shr, &&op_subn, &&op_shl, &&op_sneReg, &&op_ldIndex, &&op_jpOffset, &&op_rnd,
+    &&op_drw, &&op_skp, &&op_sknp, &&op_ldVxDt, &&op_ldVxKey, &&op_ldDtVx, &&op_ldStVx,
+    &&op_addIndex, &&op_ldFont, &&op_ldBcd, &&op_storeRegs, &&op_loadRegs
+  };
 
-      drawVRAM(vram, scale);
-      vramDirty = false;
+  const unsigned long long end = cycles + count;
+  const Instruction *instruction;
+
+#define CHIP8_NEXT()                            \
+  if (cycles == end) {                          \
+    return;                                     \
+  }                                             \
+  if ((pc & 0xFFF) < 0x200) {                   \
+    goto uncached;                              \
+  }                                             \
+  instruction = &decoded[(pc & 0xFFF) - 0x200]; \
+  pc += 2;                                      \
+  cycles++;                                     \
+  goto *labels[instruction->op]
+
+#define CHIP8_OP(name)            \
+  op_##name:                      \
+  Ops::name(*this, *instruction); \
+  CHIP8_NEXT()
+
+  CHIP8_NEXT();
+
+uncached:
+  stepUncached();
+  CHIP8_NEXT();
+
+  CHIP8_OP(decode);
+  CHIP8_OP(nop);
+  CHIP8_OP(cls);
+  CHIP8_OP(ret);
+  CHIP8_OP(jp);
+  CHIP8_OP(call);
+  CHIP8_OP(seByte);
+  CHIP8_OP(sneByte);
+  CHIP8_OP(seReg);
+  CHIP8_OP(ldByte);
+  CHIP8_OP(addByte);
+  CHIP8_OP(ldReg);
+  CHIP8_OP(orReg);
+  CHIP8_OP(andReg);
+  CHIP8_OP(xorReg);
+  CHIP8_OP(addReg);
+  CHIP8_OP(subReg);
+  CHIP8_OP(shr);
+  CHIP8_OP(subn);
+  CHIP8_OP(shl);
+  CHIP8_OP(sneReg);
+  CHIP8_OP(ldIndex);
+  CHIP8_OP(jpOffset);
+  CHIP8_OP(rnd);
+  CHIP8_OP(drw);
+  CHIP8_OP(skp);
+  CHIP8_OP(sknp);
+  CHIP8_OP(ldVxDt);
+  CHIP8_OP(ldVxKey);
+  CHIP8_OP(ldDtVx);
+  CHIP8_OP(ldStVx);
+  CHIP8_OP(addIndex);
+  CHIP8_OP(ldFont);
+  CHIP8_OP(ldBcd);
+  CHIP8_OP(storeRegs);
+  CHIP8_OP(loadRegs);
+
+#undef CHIP8_OP
+#undef CHIP8_NEXT
+#else
+  // No labels-as-values, the predecoded loop is the closest equivalent
+  runPredecoded(count);
+#endif
+}
 
-      glfwSwapBuffers(window);
+void Chip8::stepUncached() {
+  // Fetch
+  unsigned short opcode = (memory[pc & 0xFFF] << 8) | memory[(pc + 1) & 0xFFF];
+  pc += 2;
+
+  // Decode and execute
+  unsigned short nibble = opcode & 0xF000;
+  unsigned char x = (opcode & 0x0F00) >> 8;
+  unsigned char y = (opcode & 0x00F0) >> 4;
+  unsigned char n = opcode & 0x000F;
+  unsigned short nn = opcode & 0x00FF;
+  unsigned short nnn = opcode & 0x0FFF;
+
+  bool keyPressed = false;
+
+  switch (nibble) {
+  case 0x0000:
+    switch (nnn) {
+    case 0x0E0: // 00E0 - CLS
+      clearScreen();
+      break;
+    case 0x0EE: // 00EE - RET
+      pc = stack[sp];
+      sp = (sp - 1) & 0xF;
+      break;
     }
+    break;
 
-    totalTime = glfwGetTime();
-    deltaTime = totalTime - lastTime;
+  case 0x1000: // 1NNN - JP addr
+    pc = nnn;
+    break;
 
-    // Update timers
-    if (totalTime - timerLastDecrement >= 1.0F / 60.0F) {
-      if (delayTimer > 0) {
-        delayTimer--;
-      }
-      if (soundTimer > 0) {
-        soundTimer--;
-      }
-      timerLastDecrement = totalTime;
+  case 0x2000: // 2NNN - CALL addr
+    sp = (sp + 1) & 0xF;
+    stack[sp] = pc;
+    pc = nnn;
+    break;
+
+  case 0x3000: // 3XNN - SE Vx, byte
+    if (v[x] == nn) {
+      pc += 2;
     }
+    break;
 
-    if (deltaTime < targetCycleTime) {
-      continue;
+  case 0x4000: // 4XNN - SNE Vx, byte
+    if (v[x] != nn) {
+      pc += 2;
     }
+    break;
 
-    // Handle key presses
-    handleKeys(window, keys);
+  case 0x5000: // 5XY0 - SE Vx, Vy
+    if (v[x] == v[y]) {
+      pc += 2;
+    }
+    break;
 
-    // Execute one cycle
+  case 0x6000: // 6XNN - LD Vx, byte
+    v[x] = nn;
+    break;
 
-    // Fetch
-    unsigned short opcode = (memory[pc] << 8) | memory[pc + 1];
-    pc += 2;
+  case 0x7000: // 7XNN - ADD Vx, byte
+    v[x] += nn;
+    break;
 
-    // Decode and execute
-    unsigned short nibble = opcode & 0xF000;
-    unsigned char x = (opcode & 0x0F00) >> 8;
-    unsigned char y = (opcode & 0x00F0) >> 4;
-    unsigned char n = opcode & 0x000F;
-    unsigned short nn = opcode & 0x00FF;
-    unsigned short nnn = opcode & 0x0FFF;
-
-    bool keyPressed = false;
-
-    switch (nibble) {
-    case 0x0000:
-      switch (nnn) {
-      case 0x0E0: // 00E0 - CLS
-        memset(vram, 0, sizeof(vram));
-        vramDirty = true;
-        break;
-      case 0x0EE: // 00EE - RET
-        pc = stack[sp];
-        sp--;
-        break;
-      }
+  case 0x8000:
+    switch (n) {
+    case 0: // 0x8XY0 - LD Vx, Vy
+      v[x] = v[y];
       break;
-
-    case 0x1000: // 1NNN - JP addr
-      pc = nnn;
+    case 1: // 0x8XY1 - OR Vx, Vy
+      v[x] |= v[y];
       break;
-
-    case 0x2000: // 2NNN - CALL addr
-      sp++;
-      stack[sp] = pc;
-      pc = nnn;
+    case 2: // 0x8XY2 - AND Vx, Vy
+      v[x] &= v[y];
       break;
-
-    case 0x3000: // 3XNN - SE Vx, byte
-      if (v[x] == nn) {
-        pc += 2;
-      }
+    case 3: // 0x8XY3 - XOR Vx, Vy
+      v[x] ^= v[y];
       break;
-
-    case 0x4000: // 4XNN - SNE Vx, byte
-      if (v[x] != nn) {
-        pc += 2;
-      }
+    case 4: // 0x8XY4 - ADD Vx, Vy
+      v[0xF] = (((int)v[x] + (int)v[y]) > 255) ? 1 : 0;
+      v[x] += v[y];
       break;
-
-    case 0x5000: // 5XY0 - SE Vx, Vy
-      if (v[x] == v[y]) {
-        pc += 2;
-      }
+    case 5: // 0x8XY5 - SUB Vx, Vy
+      v[0xF] = (v[x] > v[y]) ? 1 : 0;
+      v[x] -= v[y];
       break;
-
-    case 0x6000: // 6XNN - LD Vx, byte
-      v[x] = nn;
+    case 6: // 0x8XY6 - SHR Vx {, Vy}
+      v[0xF] = v[x] & 0x1;
+      v[x] >>= 1;
       break;
-
-    case 0x7000: // 7XNN - ADD Vx, byte
-      v[x] += nn;
+    case 7: // 0x8XY7 - SUBN Vx, Vy
+      v[0xF] = (v[y] > v[x]) ? 1 : 0;
+      v[x] = v[y] - v[x];
+      break;
+    case 0xE: // 0x8XYE - SHL Vx {, Vy}
+      v[0xF] = (v[x] & 0x80) >> 7;
+      v[x] <<= 1;
       break;
+    }
+    break;
+
+  case 0x9000: // 9XY0 - SNE Vx, Vy
+    if (v[x] != v[y]) {
+      pc += 2;
+    }
+    break;
+
+  case 0xA000: // ANNN - LD I, addr
+    index = nnn;
+    break;
+
+  case 0xB000: // BNNN - JP V0, addr
+    pc = v[0] + nnn;
+    break;
+
+  case 0xC000: // CXNN - RND Vx, byte
+    v[x] = random.next() & nn;
+    break;
 
-    case 0x8000:
-      switch (n) {
-      case 0: // 0x8XY0 - LD Vx, Vy
-        v[x] = v[y];
-        break;
-      case 1: // 0x8XY1 - OR Vx, Vy
-        v[x] |= v[y];
-        break;
-      case 2: // 0x8XY2 - AND Vx, Vy
-        v[x] &= v[y];
-        break;
-      case 3: // 0x8XY3 - XOR Vx, Vy
-        v[x] ^= v[y];
-        break;
-      case 4: // 0x8XY4 - ADD Vx, Vy
-        v[0xF] = (((int)v[x] + (int)v[y]) > 255) ? 1 : 0;
-        v[x] += v[y];
-        break;
-      case 5: // 0x8XY5 - SUB Vx, Vy
-        v[0xF] = (v[x] > v[y]) ? 1 : 0;
-        v[x] -= v[y];
-        break;
-      case 6: // 0x8XY6 - SHR Vx {, Vy}
-        v[0xF] = v[x] & 0x1;
-        v[x] >>= 1;
-        break;
-      case 7: // 0x8XY7 - SUBN Vx, Vy
-        v[0xF] = (v[y] > v[x]) ? 1 : 0;
-        v[x] = v[y] - v[x];
-        break;
-      case 0xE: // 0x8XYE - SHL Vx {, Vy}
-        v[0xF] = (v[x] & 0x80) >> 7;
-        v[x] <<= 1;
-        break;
+  case 0xD000: // DXYN - DRW Vx, Vy, nibble
+    drawSprite(x, y, n);
+    break;
+
+  case 0xE000:
+    switch (nn) {
+    case 0x9E: // EX9E - SKP Vx
+      if (keys[v[x] & 0xF]) {
+        pc += 2;
       }
       break;
-
-    case 0x9000: // 9XY0 - SNE Vx, Vy
-      if (v[x] != v[y]) {
+    case 0xA1: // EXA1 - SKNP Vx
+      if (!keys[v[x] & 0xF]) {
         pc += 2;
       }
       break;
-
-    case 0xA000: // ANNN - LD I, addr
-      index = nnn;
+    }
+    break;
+  case 0xF000:
+    switch (nn) {
+    case 0x07: // FX07 - LD Vx, DT
+      v[x] = delayTimer;
       break;
-
-    case 0xB000: // BNNN - JP V0, addr
-      pc = v[0] + nnn;
+    case 0x15: // FX15 - LD DT, Vx
+      delayTimer = v[x];
       break;
-
-    case 0xC000: // CXNN - RND Vx, byte
-      v[x] = (rand() & 255) & nn;
+    case 0x18: // FX18 - LD ST, Vx
+      setSoundTimer(v[x]);
       break;
-
-    case 0xD000: // DXYN - DRW Vx, Vy, nibble
-      v[0xF] = 0;
-
-      for (int yLine = 0; yLine < n; yLine++) {
-        const unsigned char pixel = memory[index + yLine];
-        for (int xLine = 0; xLine < 8; xLine++) {
-          if ((pixel & (0x80 >> xLine)) != 0) {
-            if (readPixel((v[x] & 63) + xLine, (v[y] & 31) + yLine)) {
-              v[0xF] = 1;
-            }
-            writePixel((v[x] & 63) + xLine, (v[y] & 31) + yLine, !readPixel((v[x] & 63) + xLine, (v[y] & 31) + yLine));
-          }
+    case 0x1E: // FX1E - ADD I, Vx
+      index += v[x];
+      v[0xF] = (index > 0xFFF) ? 1 : 0;
+      break;
+    case 0x0A: // FX0A - Get key
+      for (int i = 0; i < 0xF; i++) {
+        if (keys[i]) {
+          v[x] = i;
+          keyPressed = true;
+          break;
         }
       }
-
+      if (!keyPressed)
+        pc -= 2;
       break;
-
-    case 0xE000:
-      switch (nn) {
-      case 0x9E: // EX9E - SKP Vx
-        if (keys[v[x]]) {
-          pc += 2;
-        }
-        break;
-      case 0xA1: // EXA1 - SKNP Vx
-        if (!keys[v[x]]) {
-          pc += 2;
-        }
-        break;
+    case 0x29: // FX29 - LD F, Vx
+      index = 0x50 + (v[x] * 5);
+      break;
+    case 0x33: // FX33 - LD B, Vx
+      memory[index & 0xFFF] = v[x] / 100;
+      memory[(index + 1) & 0xFFF] = (v[x] / 10) % 10;
+      memory[(index + 2) & 0xFFF] = v[x] % 10;
+      for (int i = 0; i < 3; i++) {
+        invalidateDecoded(index + i);
       }
       break;
-    case 0xF000:
-      switch (nn) {
-      case 0x07: // FX07 - LD Vx, DT
-        v[x] = delayTimer;
-        break;
-      case 0x15: // FX15 - LD DT, Vx
-        delayTimer = v[x];
-        break;
-      case 0x18: // FX18 - LD ST, Vx
-        soundTimer = v[x];
-        break;
-      case 0x1E: // FX1E - ADD I, Vx
-        index += v[x];
-        v[0xF] = (index > 0xFFF) ? 1 : 0;
-        break;
-      case 0x0A: // FX0A - Get key
-        for (int i = 0; i < 0xF; i++) {
-          if (keys[i]) {
-            v[x] = i;
-            keyPressed = true;
-            break;
-          }
-        }
-        if (!keyPressed)
-          pc -= 2;
-        break;
-      case 0x29: // FX29 - LD F, Vx
-        index = 0x50 + (v[x] * 5);
-        break;
-      case 0x33: // FX33 - LD B, Vx
-        memory[index] = v[x] / 100;
-        memory[index + 1] = (v[x] / 10) % 10;
-        memory[index + 2] = v[x] % 10;
-        break;
-      case 0x55: // FX55 - LD [I], Vx
-        for (int i = 0; i <= x; i++) {
-          memory[index + i] = v[i];
-        }
-        break;
-      case 0x65: // FX65 - LD Vx, [I]
-        for (int i = 0; i <= x; i++) {
-          v[i] = memory[index + i];
-        }
-        break;
+    case 0x55: // FX55 - LD [I], Vx
+      for (int i = 0; i <= x; i++) {
+        memory[(index + i) & 0xFFF] = v[i];
+        invalidateDecoded(index + i);
+      }
+      break;
+    case 0x65: // FX65 - LD Vx, [I]
+      for (int i = 0; i <= x; i++) {
+        v[i] = memory[(index + i) & 0xFFF];
       }
       break;
     }
-
-    lastTime = totalTime;
-    glfwPollEvents();
-    glfwSetWindowTitle(window, std::format("Chip-8 by @dcronqvist - {:} DT, {:} ST", delayTimer, soundTimer).c_str());
+    break;
   }
 
-  glfwDestroyWindow(window);
-  glfwTerminate();
-  return 0;
+  cycles++;
 }
@@ -0,0 +1,442 @@
+#include <algorithm>
+#include <string.h>
+
+#include "chip8_analyzer.h"
+
+namespace {
+  bool isSkip(unsigned short opcode) {
+    switch (opcode & 0xF000) {
+    case 0x3000:
+    case 0x4000:
+      return true;
+    case 0x5000:
+    case 0x9000:
+      return (opcode & 0xF) == 0;
+    case 0xE000:
+      return (opcode & 0xFF) == 0x9E || (opcode & 0xFF) == 0xA1;
+    }
+    return false;
+  }
+
+  const char *edgeNames[] = { "fallthrough", "jump", "skip", "call" };
+}
+
+Chip8Analyzer::Chip8Analyzer(std::span<const unsigned char> rom) {
+  memset(memory, 0, sizeof(memory));
+  memset(code, 0, sizeof(code));
+  memset(leader, 0, sizeof(leader));
+  memset(callTarget, 0, sizeof(callTarget));
+
+  size_t size = std::min(rom.size(), (size_t)(4096 - 0x200));
+  memcpy(&memory[0x200], rom.data(), size);
+  romEnd = (unsigned short)(0x200 + size);
+
+  trace();
+  buildBlocks();
+  buildSubroutines();
+  checkStores();
+
+  std::stable_sort(findings.begin(), findings.end(), [](const Finding &a, const Finding &b) { return a.address < b.address; });
+}
+
+void Chip8Analyzer::addFinding(unsigned short address, const std::string &message) {
+  findings.push_back({ address, opcodeAt(address), message });
+}
+
+void Chip8Analyzer::trace() {
+  std::vector<unsigned short> pending = { 0x200 };
+  leader[0x200] = true;
+
+  // Queues a control flow target, reporting the ones that leave program memory
+  auto follow = [&](unsigned short from, unsigned short target) {
+    if (target < 0x200 || target > 0xFFE) {
+      char message[64];
+      snprintf(message, sizeof(message), "target 0x%03X is outside program memory", target);
+      addFinding(from, message);
+      return;
+    }
+    leader[target] = true;
+    pending.push_back(target);
+  };
+
+  while (!pending.empty()) {
+    unsigned short address = pending.back();
+    pending.pop_back();
+
+    // Run straight-line code until something changes the flow
+    while (!code[address]) {
+      code[address] = true;
+      unsigned short opcode = opcodeAt(address);
+      unsigned short next = address + 2;
+
+      if (opcode == 0x00EE) {
+        break;
+      }
+      else if ((opcode & 0xF000) == 0x1000) {
+        follow(address, opcode & 0xFFF);
+        break;
+      }
+      else if ((opcode & 0xF000) == 0xB000) {
+        char message[64];
+        snprintf(message, sizeof(message), "indirect jump, somewhere in 0x%03X-0x%03X", opcode & 0xFFF, (opcode & 0xFFF) + 0xFF);
+        addFinding(address, message);
+        break;
+      }
+      else if ((opcode & 0xF000) == 0x2000) {
+        callTarget[opcode & 0xFFF] = true;
+        follow(address, opcode & 0xFFF);
+        follow(address, next);
+        break;
+      }
+      else if (isSkip(opcode)) {
+        follow(address, next);
+        follow(address, next + 2);
+        break;
+      }
+
+      if (next > 0xFFE) {
+        addFinding(address, "runs off the end of memory");
+        break;
+      }
+
+      // Falling into code that another path already reached, so a block starts there
+      if (code[next]) {
+        leader[next] = true;
+      }
+      address = next;
+    }
+  }
+}
+
+void Chip8Analyzer::buildBlocks() {
+  for (unsigned short start = 0x200; start <= 0xFFE; start++) {
+    if (!code[start] || !leader[start]) {
+      continue;
+    }
+
+    Block block = { start, start, {}, false, false };
+
+    // Successors that left memory were reported by trace() and are dropped here
+    auto addEdge = [&](unsigned short target, EdgeKind kind) {
+      if (target <= 0xFFE && code[target]) {
+        block.successors.push_back({ target, kind });
+      }
+    };
+
+    unsigned short address = start;
+    while (true) {
+      unsigned short opcode = opcodeAt(address);
+      unsigned short next = address + 2;
+      block.end = next;
+
+      if (opcode == 0x00EE) {
+        block.returns = true;
+        break;
+      }
+      else if ((opcode & 0xF000) == 0x1000) {
+        addEdge(opcode & 0xFFF, Edge_Jump);
+        break;
+      }
+      else if ((opcode & 0xF000) == 0xB000) {
+        block.indirect = true;
+        break;
+      }
+      else if ((opcode & 0xF000) == 0x2000) {
+        addEdge(opcode & 0xFFF, Edge_Call);
+        addEdge(next, Edge_Fallthrough);
+        break;
+      }
+      else if (isSkip(opcode)) {
+        addEdge(next, Edge_Fallthrough);
+        addEdge(next + 2, Edge_Skip);
+        break;
+      }
+
+      if (next > 0xFFE || !code[next]) {
+        break;
+      }
+      if (leader[next]) {
+        addEdge(next, Edge_Fallthrough);
+        break;
+      }
+      address = next;
+    }
+
+    blocks[start] = block;
+  }
+}
+
+void Chip8Analyzer::buildSubroutines() {
+  std::vector<unsigned short> entries = { 0x200 };
+  for (unsigned short address = 0x202; address <= 0xFFE; address++) {
+    if (callTarget[address] && code[address]) {
+      entries.push_back(address);
+    }
+  }
+
+  for (unsigned short entry : entries) {
+    Subroutine subroutine = { entry, {}, {} };
+
+    // Blocks reachable from the entry, stepping over calls
+    std::vector<bool> seen(4096, false);
+    std::vector<unsigned short> pending = { entry };
+    seen[entry] = true;
+    while (!pending.empty()) {
+      unsigned short start = pending.back();
+      pending.pop_back();
+      subroutine.blocks.push_back(start);
+
+      for (const Edge &edge : blocks.at(start).successors) {
+        if (edge.kind == Edge_Call) {
+          subroutine.callees.push_back(edge.target);
+        }
+        else if (!seen[edge.target]) {
+          seen[edge.target] = true;
+          pending.push_back(edge.target);
+        }
+      }
+    }
+
+    std::sort(subroutine.blocks.begin(), subroutine.blocks.end());
+    std::sort(subroutine.callees.begin(), subroutine.callees.end());
+    subroutine.callees.erase(std::unique(subroutine.callees.begin(), subroutine.callees.end()), subroutine.callees.end());
+    subroutines.push_back(subroutine);
+  }
+}
+
+void Chip8Analyzer::checkStores() {
+  // I is only tracked within a block, from an ANNN to the store
+  for (const auto &[start, block] : blocks) {
+    bool indexKnown = false;
+    unsigned short index = 0;
+
+    for (unsigned short address = block.start; address < block.end; address += 2) {
+      unsigned short opcode = opcodeAt(address);
+      int length = 0;
+
+      if ((opcode & 0xF000) == 0xA000) {
+        indexKnown = true;
+        index = opcode & 0xFFF;
+      }
+      else if ((opcode & 0xF0FF) == 0xF01E) {
+        indexKnown = false;
+      }
+      else if ((opcode & 0xF0FF) == 0xF033) {
+        length = 3;
+      }
+      else if ((opcode & 0xF0FF) == 0xF055) {
+        length = ((opcode >> 8) & 0xF) + 1;
+      }
+
+      if (length == 0) {
+        continue;
+      }
+      if (!indexKnown) {
+        addFinding(address, "store through an I computed at run time");
+        continue;
+      }
+
+      // A byte is code if an instruction starts on it or on the byte before
+      for (int i = 0; i < length; i++) {
+        unsigned short target = (index + i) & 0xFFF;
+        if (code[target] || code[(target - 1) & 0xFFF]) {
+          char message[64];
+          snprintf(message, sizeof(message), "self-modifying, writes code at 0x%03X", target);
+          addFinding(address, message);
+          break;
+        }
+      }
+    }
+  }
+}
+
+std::vector<unsigned short> Chip8Analyzer::getInstructions() const {
+  std::vector<unsigned short> instructions;
+  for (unsigned short address = 0x200; address <= 0xFFE; address++) {
+    if (code[address]) {
+      instructions.push_back(address);
+    }
+  }
+  return instructions;
+}
+
+std::vector<unsigned short> Chip8Analyzer::getBlockStarts() const {
+  std::vector<unsigned short> starts;
+  for (const auto &[start, block] : blocks) {
+    starts.push_back(start);
+  }
+  return starts;
+}
+
+std::string Chip8Analyzer::disassemble(unsigned short opcode) {
+  unsigned int x = (opcode >> 8) & 0xF;
+  unsigned int y = (opcode >> 4) & 0xF;
+  unsigned int n = opcode & 0xF;
+  unsigned int nn = opcode & 0xFF;
+  unsigned int nnn = opcode & 0xFFF;
+  char text[32];
+
+  switch (opcode & 0xF000) {
+  case 0x0000:
+    if (opcode == 0x00E0) return "CLS";
+    if (opcode == 0x00EE) return "RET";
+    snprintf(text, sizeof(text), "SYS 0x%03X", nnn);
+    break;
+  case 0x1000: snprintf(text, sizeof(text), "JP 0x%03X", nnn); break;
+  case 0x2000: snprintf(text, sizeof(text), "CALL 0x%03X", nnn); break;
+  case 0x3000: snprintf(text, sizeof(text), "SE V%X, 0x%02X", x, nn); break;
+  case 0x4000: snprintf(text, sizeof(text), "SNE V%X, 0x%02X", x, nn); break;
+  case 0x6000: snprintf(text, sizeof(text), "LD V%X, 0x%02X", x, nn); break;
+  case 0x7000: snprintf(text, sizeof(text), "ADD V%X, 0x%02X", x, nn); break;
+  case 0xA000: snprintf(text, sizeof(text), "LD I, 0x%03X", nnn); break;
+  case 0xB000: snprintf(text, sizeof(text), "JP V0, 0x%03X", nnn); break;
+  case 0xC000: snprintf(text, sizeof(text), "RND V%X, 0x%02X", x, nn); break;
+  case 0xD000: snprintf(text, sizeof(text), "DRW V%X, V%X, %u", x, y, n); break;
+  case 0x5000:
+  case 0x9000:
+    if (n != 0) {
+      snprintf(text, sizeof(text), "DW 0x%04X", opcode);
+    }
+    else {
+      snprintf(text, sizeof(text), "%s V%X, V%X", (opcode & 0xF000) == 0x5000 ? "SE" : "SNE", x, y);
+    }
+    break;
+  case 0x8000: {
+    static const char *const names[16] = { "LD", "OR", "AND", "XOR", "ADD", "SUB", "SHR", "SUBN", nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, "SHL", nullptr };
+    if (names[n]) {
+      snprintf(text, sizeof(text), "%s V%X, V%X", names[n], x, y);
+    }
+    else {
+      snprintf(text, sizeof(text), "DW 0x%04X", opcode);
+    }
+    break;
+  }
+  case 0xE000:
+    if (nn == 0x9E) snprintf(text, sizeof(text), "SKP V%X", x);
+    else if (nn == 0xA1) snprintf(text, sizeof(text), "SKNP V%X", x);
+    else snprintf(text, sizeof(text), "DW 0x%04X", opcode);
+    break;
+  case 0xF000:
+    switch (nn) {
+    case 0x07: snprintf(text, sizeof(text), "LD V%X, DT", x); break;
+    case 0x0A: snprintf(text, sizeof(text), "LD V%X, K", x); break;
+    case 0x15: snprintf(text, sizeof(text), "LD DT, V%X", x); break;
+    case 0x18: snprintf(text, sizeof(text), "LD ST, V%X", x); break;
+    case 0x1E: snprintf(text, sizeof(text), "ADD I, V%X", x); break;
+    case 0x29: snprintf(text, sizeof(text), "LD F, V%X", x); break;
+    case 0x33: snprintf(text, sizeof(text), "LD B, V%X", x); break;
+    case 0x55: snprintf(text, sizeof(text), "LD [I], V%X", x); break;
+    case 0x65: snprintf(text, sizeof(text), "LD V%X, [I]", x); break;
+    default: snprintf(text, sizeof(text), "DW 0x%04X", opcode); break;
+    }
+    break;
+  }
+
+  return text;
+}
+
+void Chip8Analyzer::writeListing(FILE *out) const {
+  unsigned short end = romEnd;
+  for (unsigned short address = 0x200; address <= 0xFFE; address++) {
+    if (code[address]) {
+      end = std::max(end, (unsigned short)(address + 2));
+    }
+  }
+
+  size_t finding = 0;
+  unsigned short address = 0x200;
+  while (address < end) {
+    if (!code[address]) {
+      // Up to eight data bytes per line, stopping at the next instruction
+      fprintf(out, "    %03X        DB", address);
+      for (int i = 0; i < 8 && address < end && !code[address]; i++, address++) {
+        fprintf(out, "%s0x%02X", i == 0 ? " " : ", ", memory[address]);
+      }
+      fputc('\n', out);
+      continue;
+    }
+
+    if (leader[address]) {
+      fprintf(out, "%s_%03X:\n", callTarget[address] || address == 0x200 ? "sub" : "loc", address);
+    }
+
+    unsigned short opcode = opcodeAt(address);
+    fprintf(out, "    %03X  %04X  %s", address, opcode, disassemble(opcode).c_str());
+    while (finding < findings.size() && findings[finding].address < address) {
+      finding++;
+    }
+    int padding = 16 - (int)disassemble(opcode).size();
+    for (const char *separator = " ; "; finding < findings.size() && findings[finding].address == address; finding++, separator = ", ") {
+      fprintf(out, "%*s%s%s", separator[0] == ' ' ? std::max(padding, 0) : 0, "", separator, findings[finding].message.c_str());
+    }
+    fputc('\n', out);
+    address += 2;
+  }
+}
+
+void Chip8Analyzer::writeDot(FILE *out) const {
+  fprintf(out, "digraph cfg {\n");
+  fprintf(out, "  node [shape=box, fontname=\"monospace\"];\n");
+
+  // Subroutine entries get a double border, blocks ending in BNNN a red one
+  for (const auto &[start, block] : blocks) {
+    fprintf(out, "  b%03X [label=\"", start);
+    if (callTarget[start] || start == 0x200) {
+      fprintf(out, "sub_%03X\\l", start);
+    }
+    for (unsigned short address = block.start; address < block.end; address += 2) {
+      fprintf(out, "%03X  %s\\l", address, disassemble(opcodeAt(address)).c_str());
+    }
+    fprintf(out, "\"%s%s];\n", callTarget[start] || start == 0x200 ? ", peripheries=2" : "", block.indirect ? ", color=red" : "");
+  }
+
+  static const char *const edgeStyles[] = { "", " [style=bold]", " [style=dashed, label=\"skip\"]", " [style=dotted, color=blue]" };
+  for (const auto &[start, block] : blocks) {
+    for (const Edge &edge : block.successors) {
+      fprintf(out, "  b%03X -> b%03X%s;\n", start, edge.target, edgeStyles[edge.kind]);
+    }
+  }
+
+  fprintf(out, "}\n");
+}
+
+void Chip8Analyzer::writeJson(FILE *out) const {
+  fprintf(out, "{\n  \"entry\": %u,\n  \"blocks\": [\n", 0x200);
+
+  size_t blockIndex = 0;
+  for (const auto &[start, block] : blocks) {
+    fprintf(out, "    { \"start\": %u, \"end\": %u, \"returns\": %s, \"indirect\": %s,\n", block.start, block.end, block.returns ? "true" : "false", block.indirect ? "true" : "false");
+
+    fprintf(out, "      \"instructions\": [");
+    for (unsigned short address = block.start; address < block.end; address += 2) {
+      unsigned short opcode = opcodeAt(address);
+      fprintf(out, "%s{ \"address\": %u, \"opcode\": %u, \"text\": \"%s\" }", address == block.start ? " " : ", ", address, opcode, disassemble(opcode).c_str());
+    }
+
+    fprintf(out, " ],\n      \"successors\": [");
+    for (size_t i = 0; i < block.successors.size(); i++) {
+      fprintf(out, "%s{ \"target\": %u, \"kind\": \"%s\" }", i == 0 ? " " : ", ", block.successors[i].target, edgeNames[block.successors[i].kind]);
+    }
+    fprintf(out, " ] }%s\n", ++blockIndex < blocks.size() ? "," : "");
+  }
+
+  fprintf(out, "  ],\n  \"subroutines\": [\n");
+  for (size_t i = 0; i < subroutines.size(); i++) {
+    const Subroutine &subroutine = subroutines[i];
+    fprintf(out, "    { \"entry\": %u, \"blocks\": [", subroutine.entry);
+    for (size_t j = 0; j < subroutine.blocks.size(); j++) {
+      fprintf(out, "%s%u", j == 0 ? " " : ", ", subroutine.blocks[j]);
+    }
+    fprintf(out, " ], \"callees\": [");
+    for (size_t j = 0; j < subroutine.callees.size(); j++) {
+      fprintf(out, "%s%u", j == 0 ? " " : ", ", subroutine.callees[j]);
+    }
+    fprintf(out, " ] }%s\n", i + 1 < subroutines.size() ? "," : "");
+  }
+
+  fprintf(out, "  ],\n  \"findings\": [\n");
+  for (size_t i = 0; i < findings.size(); i++) {
+    fprintf(out, "    { \"address\": %u, \"opcode\": %u, \"message\": \"%s\" }%s\n", findings[i].address, findings[i].opcode, findings[i].message.c_str(), i + 1 < findings.size() ? "," : "");
+  }
+  fprintf(out, "  ]\n}\n");
+}
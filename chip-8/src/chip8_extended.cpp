@@ -0,0 +1,623 @@
+#include <cstring>
+#include <cassert>
+
+#include "chip8_extended.h"
+
+namespace {
+  const unsigned char smallFont[16 * 5] = {
+    0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
+    0x20, 0x60, 0x20, 0x20, 0x70, // 1
+    0xF0, 0x10, 0xF0, 0x80, 0xF0, // 2
+    0xF0, 0x10, 0xF0, 0x10, 0xF0, // 3
+    0x90, 0x90, 0xF0, 0x10, 0x10, // 4
+    0xF0, 0x80, 0xF0, 0x10, 0xF0, // 5
+    0xF0, 0x80, 0xF0, 0x90, 0xF0, // 6
+    0xF0, 0x10, 0x20, 0x40, 0x40, // 7
+    0xF0, 0x90, 0xF0, 0x90, 0xF0, // 8
+    0xF0, 0x90, 0xF0, 0x10, 0xF0, // 9
+    0xF0, 0x90, 0xF0, 0x90, 0x90, // A
+    0xE0, 0x90, 0xE0, 0x90, 0xE0, // B
+    0xF0, 0x80, 0x80, 0x80, 0xF0, // C
+    0xE0, 0x90, 0x90, 0x90, 0xE0, // D
+    0xF0, 0x80, 0xF0, 0x80, 0xF0, // E
+    0xF0, 0x80, 0xF0, 0x80, 0x80  // F
+  };
+
+  // 8x10 digits for FX30. SUPER-CHIP only defines 0-9, XO-CHIP adds A-F.
+  const unsigned char bigFont[16 * 10] = {
+    0xFF, 0xFF, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, // 0
+    0x18, 0x78, 0x78, 0x18, 0x18, 0x18, 0x18, 0x18, 0xFF, 0xFF, // 1
+    0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // 2
+    0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 3
+    0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0x03, 0x03, // 4
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 5
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 6
+    0xFF, 0xFF, 0x03, 0x03, 0x06, 0x0C, 0x18, 0x18, 0x18, 0x18, // 7
+    0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 8
+    0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 9
+    0x7E, 0xFF, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3, // A
+    0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, // B
+    0x3C, 0xFF, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0xFF, 0x3C, // C
+    0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC, // D
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // E
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xC0, 0xC0  // F
+  };
+
+  constexpr unsigned short smallFontAddress = 0x50;
+  constexpr unsigned short bigFontAddress = smallFontAddress + sizeof(smallFont);
+
+  // Every bit twice, for lores sprites on the 128x64 framebuffer
+  unsigned int doubleBits(unsigned int bits, int width) {
+    unsigned int doubled = 0;
+    for (int i = 0; i < width; i++) {
+      doubled |= ((bits >> i) & 1) * (3u << (2 * i));
+    }
+    return doubled;
+  }
+}
+
+template <typename Mode, typename Quirks>
+Chip8Extended<Mode, Quirks>::Chip8Extended(const unsigned char *gameBinaryData, unsigned int gameBinaryDataSize, unsigned long long seed) {
+  // -- Initialize VRAM --
+  memset(vram, 0, sizeof(vram));
+  vramDirty = true;
+  hires = false;
+  planeMask = 1;
+
+  // -- Initialize memory --
+  assert(gameBinaryDataSize <= Mode::memorySize - 512); // Make sure game binary data fits into memory
+  memset(memory, 0, sizeof(memory));
+  memcpy(memory + 512, gameBinaryData, gameBinaryDataSize);
+  memcpy(memory + smallFontAddress, smallFont, sizeof(smallFont));
+  memcpy(memory + bigFontAddress, bigFont, sizeof(bigFont));
+
+  // -- Initialize the rest --
+  memset(stack, 0, sizeof(stack));
+  sp = 0;
+  delayTimer = 0;
+  soundTimer = 0;
+  memset(keys, 0, sizeof(keys));
+  pc = 0x200;
+  index = 0;
+  memset(v, 0, sizeof(v));
+  memset(flags, 0, sizeof(flags));
+  memset(audioPattern, 0, sizeof(audioPattern));
+  pitch = 64; // 4000 Hz, the XO-CHIP default
+  exited = false;
+  frameStarted = true;
+  cycles = 0;
+
+  random.seed(seed);
+}
+
+template <typename Mode, typename Quirks>
+void Chip8Extended<Mode, Quirks>::step() {
+  execute();
+  cycles++;
+}
+
+template <typename Mode, typename Quirks>
+void Chip8Extended<Mode, Quirks>::runCycles(unsigned long long count) {
+  for (unsigned long long i = 0; i < count; i++) {
+    execute();
+  }
+  cycles += count;
+}
+
+template <typename Mode, typename Quirks>
+void Chip8Extended<Mode, Quirks>::tickTimers() {
+  if (delayTimer > 0) {
+    delayTimer--;
+  }
+  if (soundTimer > 0) {
+    soundTimer--;
+  }
+  frameStarted = true;
+}
+
+template <typename Mode, typename Quirks>
+void Chip8Extended<Mode, Quirks>::setKey(unsigned char key, bool pressed) {
+  keys[key & 0xF] = pressed;
+}
+
+template <typename Mode, typename Quirks>
+void Chip8Extended<Mode, Quirks>::setKeys(unsigned short keyMask) {
+  for (int i = 0; i < 16; i++) {
+    keys[i] = (keyMask >> i) & 1;
+  }
+}
+
+template <typename Mode, typename Quirks>
+unsigned char Chip8Extended<Mode, Quirks>::getPixel(unsigned short x, unsigned short y) const {
+  x &= 127;
+  y &= 63;
+
+  unsigned char lit = 0;
+  for (int plane = 0; plane < Mode::planes; plane++) {
+    lit |= ((vram[plane][y][x >> 6] >> (63 - (x & 63))) & 1) << plane;
+  }
+  return lit;
+}
+
+template <typename Mode, typename Quirks>
+bool Chip8Extended<Mode, Quirks>::isHalted() const {
+  unsigned short opcode = (peekMemory(pc) << 8) | peekMemory(pc + 1);
+  return exited || opcode == (0x1000 | pc);
+}
+
+template <typename Mode, typename Quirks>
+inline void Chip8Extended<Mode, Quirks>::advanceIndex(unsigned char x) {
+  if constexpr (Quirks::loadStoreIndex == Chip8IndexAdvance::ByX) {
+    index += x;
+  }
+  else if constexpr (Quirks::loadStoreIndex == Chip8IndexAdvance::ByXPlusOne) {
+    index += x + 1;
+  }
+}
+
+template <typename Mode, typename Quirks>
+inline void Chip8Extended<Mode, Quirks>::skip() {
+  // F000 NNNN is the only four byte instruction
+  if constexpr (Mode::xoChip) {
+    if (memory[pc & addressMask] == 0xF0 && memory[(pc + 1) & addressMask] == 0x00) {
+      pc += 2;
+    }
+  }
+  pc += 2;
+}
+
+template <typename Mode, typename Quirks>
+void Chip8Extended<Mode, Quirks>::clearPlanes() {
+  for (int plane = 0; plane < Mode::planes; plane++) {
+    if (planeMask & (1 << plane)) {
+      memset(vram[plane], 0, sizeof(vram[plane]));
+    }
+  }
+  vramDirty = true;
+}
+
+template <typename Mode, typename Quirks>
+void Chip8Extended<Mode, Quirks>::scrollVertical(int rows) {
+  for (int plane = 0; plane < Mode::planes; plane++) {
+    if (!(planeMask & (1 << plane))) {
+      continue;
+    }
+
+    unsigned long long(&rowsOf)[64][2] = vram[plane];
+    if (rows > 0) {
+      memmove(rowsOf[rows], rowsOf[0], sizeof(rowsOf[0]) * (64 - rows));
+      memset(rowsOf[0], 0, sizeof(rowsOf[0]) * rows);
+    }
+    else if (rows < 0) {
+      memmove(rowsOf[0], rowsOf[-rows], sizeof(rowsOf[0]) * (64 + rows));
+      memset(rowsOf[64 + rows], 0, sizeof(rowsOf[0]) * -rows);
+    }
+  }
+  vramDirty = true;
+}
+
+template <typename Mode, typename Quirks>
+void Chip8Extended<Mode, Quirks>::scrollHorizontal(int columns) {
+  // Only ever 4 or 8 columns, so a row is shifted as one 128-bit value
+  for (int plane = 0; plane < Mode::planes; plane++) {
+    if (!(planeMask & (1 << plane))) {
+      continue;
+    }
+
+    for (int y = 0; y < 64; y++) {
+      unsigned long long &left = vram[plane][y][0];
+      unsigned long long &right = vram[plane][y][1];
+      if (columns > 0) {
+        right = (right >> columns) | (left << (64 - columns));
+        left >>= columns;
+      }
+      else {
+        left = (left << -columns) | (right >> (64 + columns));
+        right <<= -columns;
+      }
+    }
+  }
+  vramDirty = true;
+}
+
+template <typename Mode, typename Quirks>
+bool Chip8Extended<Mode, Quirks>::drawRow(int plane, int y, unsigned int bits, int width, int x) {
+  // Line the sprite row up with the 128 pixel row, leftmost pixel in bit 63
+  unsigned long long pattern = (unsigned long long)bits << (64 - width);
+  unsigned long long left = 0;
+  unsigned long long right = 0;
+
+  if (x < 64) {
+    left = pattern >> x;
+    right = x ? pattern << (64 - x) : 0;
+  }
+  else {
+    right = pattern >> (x - 64);
+  }
+
+  // Whatever hangs off the right edge either wraps or is dropped
+  if constexpr (Quirks::wrapSprites) {
+    if (x + width > 128) {
+      left |= pattern << (128 - x);
+    }
+  }
+
+  unsigned long long(&row)[2] = vram[plane][y];
+  bool collision = (row[0] & left) || (row[1] & right);
+  row[0] ^= left;
+  row[1] ^= right;
+  return collision;
+}
+
+template <typename Mode, typename Quirks>
+void Chip8Extended<Mode, Quirks>::drawSprite(unsigned char x, unsigned char y, unsigned char n) {
+  // Work in framebuffer pixels, lores coordinates and sprites are doubled
+  int scale = hires ? 1 : 2;
+  int startX = (v[x] & (128 / scale - 1)) * scale;
+  int startY = (v[y] & (64 / scale - 1)) * scale;
+  v[0xF] = 0;
+
+  bool large = Mode::superChip && n == 0; // The VIP draws nothing for DXY0
+  int rows = large ? 16 : n;
+  int width = large ? 16 : 8;
+
+  unsigned short address = index;
+  int collidedRows = 0;
+
+  // Each selected plane takes the next rows * width bits of sprite data
+  for (int plane = 0; plane < Mode::planes; plane++) {
+    if (!(planeMask & (1 << plane))) {
+      continue;
+    }
+
+    for (int row = 0; row < rows; row++) {
+      unsigned int bits = memory[address & addressMask];
+      if (large) {
+        bits = (bits << 8) | memory[(address + 1) & addressMask];
+      }
+      address += large ? 2 : 1;
+
+      int line = startY + row * scale;
+      if (line >= 64) {
+        if constexpr (!Quirks::wrapSprites) {
+          // SUPER-CHIP counts rows clipped at the bottom as collisions, in hires only
+          if (Quirks::countCollidedRows && hires) {
+            collidedRows++;
+          }
+          continue;
+        }
+        line -= 64;
+      }
+
+      bool collision;
+      if (hires) {
+        collision = drawRow(plane, line, bits, width, startX);
+      }
+      else {
+        unsigned int doubled = doubleBits(bits, width);
+        collision = drawRow(plane, line, doubled, width * 2, startX);
+        collision |= drawRow(plane, line + 1, doubled, width * 2, startX);
+      }
+      collidedRows += collision;
+    }
+  }
+
+  if constexpr (Quirks::countCollidedRows) {
+    v[0xF] = hires ? collidedRows : collidedRows != 0;
+  }
+  else {
+    v[0xF] = collidedRows != 0;
+  }
+  vramDirty = true;
+}
+
+template <typename Mode, typename Quirks>
+void Chip8Extended<Mode, Quirks>::execute() {
+  // Fetch
+  unsigned short opcode = (memory[pc & addressMask] << 8) | memory[(pc + 1) & addressMask];
+  pc += 2;
+
+  // Decode and execute
+  unsigned char x = (opcode & 0x0F00) >> 8;
+  unsigned char y = (opcode & 0x00F0) >> 4;
+  unsigned char n = opcode & 0x000F;
+  unsigned short nn = opcode & 0x00FF;
+  unsigned short nnn = opcode & 0x0FFF;
+
+  // Lores scroll distances are in lores pixels
+  int scale = hires ? 1 : 2;
+
+  switch (opcode & 0xF000) {
+  case 0x0000:
+    if (Mode::superChip && (nnn & 0xFF0) == 0x0C0) { // 00CN - SCD n
+      scrollVertical(n * scale);
+      break;
+    }
+    if (Mode::xoChip && (nnn & 0xFF0) == 0x0D0) { // 00DN - SCU n
+      scrollVertical(-n * scale);
+      break;
+    }
+    switch (nnn) {
+    case 0x0E0: // 00E0 - CLS
+      clearPlanes();
+      break;
+    case 0x0EE: // 00EE - RET
+      pc = stack[sp];
+      sp = (sp - 1) & 0xF;
+      break;
+    }
+    if constexpr (Mode::superChip) {
+      switch (nnn) {
+      case 0x0FB: // 00FB - SCR
+        scrollHorizontal(4 * scale);
+        break;
+      case 0x0FC: // 00FC - SCL
+        scrollHorizontal(-4 * scale);
+        break;
+      case 0x0FD: // 00FD - EXIT, parks pc on itself
+        exited = true;
+        pc -= 2;
+        break;
+      case 0x0FE: // 00FE - LOW
+      case 0x0FF: // 00FF - HIGH
+        hires = nnn == 0x0FF;
+        if constexpr (Quirks::clearOnResolutionChange) {
+          memset(vram, 0, sizeof(vram));
+        }
+        vramDirty = true;
+        break;
+      }
+    }
+    break;
+
+  case 0x1000: // 1NNN - JP addr
+    pc = nnn;
+    break;
+
+  case 0x2000: // 2NNN - CALL addr
+    sp = (sp + 1) & 0xF;
+    stack[sp] = pc;
+    pc = nnn;
+    break;
+
+  case 0x3000: // 3XNN - SE Vx, byte
+    if (v[x] == nn) {
+      skip();
+    }
+    break;
+
+  case 0x4000: // 4XNN - SNE Vx, byte
+    if (v[x] != nn) {
+      skip();
+    }
+    break;
+
+  case 0x5000:
+    if (Mode::xoChip && n == 2) { // 5XY2 - LD [I], Vx-Vy
+      int step = x <= y ? 1 : -1;
+      for (int i = 0, r = x; i <= (x <= y ? y - x : x - y); i++, r += step) {
+        memory[(index + i) & addressMask] = v[r];
+      }
+    }
+    else if (Mode::xoChip && n == 3) { // 5XY3 - LD Vx-Vy, [I]
+      int step = x <= y ? 1 : -1;
+      for (int i = 0, r = x; i <= (x <= y ? y - x : x - y); i++, r += step) {
+        v[r] = memory[(index + i) & addressMask];
+      }
+    }
+    else if (v[x] == v[y]) { // 5XY0 - SE Vx, Vy
+      skip();
+    }
+    break;
+
+  case 0x6000: // 6XNN - LD Vx, byte
+    v[x] = nn;
+    break;
+
+  case 0x7000: // 7XNN - ADD Vx, byte
+    v[x] += nn;
+    break;
+
+  case 0x8000: {
+    // Flags are written after the result, so VF as the destination ends up holding the flag
+    unsigned char flag;
+    switch (n) {
+    case 0: // 0x8XY0 - LD Vx, Vy
+      v[x] = v[y];
+      break;
+    case 1: // 0x8XY1 - OR Vx, Vy
+      v[x] |= v[y];
+      if constexpr (Quirks::logicResetsVF) {
+        v[0xF] = 0;
+      }
+      break;
+    case 2: // 0x8XY2 - AND Vx, Vy
+      v[x] &= v[y];
+      if constexpr (Quirks::logicResetsVF) {
+        v[0xF] = 0;
+      }
+      break;
+    case 3: // 0x8XY3 - XOR Vx, Vy
+      v[x] ^= v[y];
+      if constexpr (Quirks::logicResetsVF) {
+        v[0xF] = 0;
+      }
+      break;
+    case 4: // 0x8XY4 - ADD Vx, Vy
+      flag = ((int)v[x] + (int)v[y]) > 255;
+      v[x] += v[y];
+      v[0xF] = flag;
+      break;
+    case 5: // 0x8XY5 - SUB Vx, Vy
+      flag = v[x] >= v[y];
+      v[x] -= v[y];
+      v[0xF] = flag;
+      break;
+    case 6: { // 0x8XY6 - SHR Vx {, Vy}
+      unsigned char source = Quirks::shiftUsesVy ? v[y] : v[x];
+      v[x] = source >> 1;
+      v[0xF] = source & 0x1;
+      break;
+    }
+    case 7: // 0x8XY7 - SUBN Vx, Vy
+      flag = v[y] >= v[x];
+      v[x] = v[y] - v[x];
+      v[0xF] = flag;
+      break;
+    case 0xE: { // 0x8XYE - SHL Vx {, Vy}
+      unsigned char source = Quirks::shiftUsesVy ? v[y] : v[x];
+      v[x] = source << 1;
+      v[0xF] = source >> 7;
+      break;
+    }
+    }
+    break;
+  }
+
+  case 0x9000: // 9XY0 - SNE Vx, Vy
+    if (v[x] != v[y]) {
+      skip();
+    }
+    break;
+
+  case 0xA000: // ANNN - LD I, addr
+    index = nnn;
+    break;
+
+  case 0xB000: // BNNN - JP V0, addr (BXNN - JP Vx, addr)
+    pc = (Quirks::jumpUsesVx ? v[x] : v[0]) + nnn;
+    break;
+
+  case 0xC000: // CXNN - RND Vx, byte
+    v[x] = random.next() & nn;
+    break;
+
+  case 0xD000: // DXYN - DRW Vx, Vy, nibble
+    if constexpr (Quirks::displayWait) {
+      // Spin on the instruction until the next tick, like the VIP waiting for vertical blank
+      if (!frameStarted) {
+        pc -= 2;
+        break;
+      }
+      frameStarted = false;
+    }
+    drawSprite(x, y, n);
+    break;
+
+  case 0xE000:
+    switch (nn) {
+    case 0x9E: // EX9E - SKP Vx
+      if (keys[v[x] & 0xF]) {
+        skip();
+      }
+      break;
+    case 0xA1: // EXA1 - SKNP Vx
+      if (!keys[v[x] & 0xF]) {
+        skip();
+      }
+      break;
+    }
+    break;
+
+  case 0xF000:
+    if (Mode::xoChip && opcode == 0xF000) { // F000 NNNN - LD I, long addr
+      index = (memory[pc & addressMask] << 8) | memory[(pc + 1) & addressMask];
+      pc += 2;
+      break;
+    }
+    switch (nn) {
+    case 0x01: // FN01 - PLANE n
+      if constexpr (Mode::xoChip) {
+        planeMask = x & 3;
+      }
+      break;
+    case 0x02: // F002 - AUDIO
+      if constexpr (Mode::xoChip) {
+        for (int i = 0; i < 16; i++) {
+          audioPattern[i] = memory[(index + i) & addressMask];
+        }
+      }
+      break;
+    case 0x07: // FX07 - LD Vx, DT
+      v[x] = delayTimer;
+      break;
+    case 0x0A: { // FX0A - Get key
+      bool keyPressed = false;
+      for (int i = 0; i < 16; i++) {
+        if (keys[i]) {
+          v[x] = i;
+          keyPressed = true;
+          break;
+        }
+      }
+      if (!keyPressed)
+        pc -= 2;
+      break;
+    }
+    case 0x15: // FX15 - LD DT, Vx
+      delayTimer = v[x];
+      break;
+    case 0x18: // FX18 - LD ST, Vx
+      soundTimer = v[x];
+      break;
+    case 0x1E: // FX1E - ADD I, Vx
+      index += v[x];
+      break;
+    case 0x29: // FX29 - LD F, Vx
+      index = smallFontAddress + (v[x] & 0xF) * 5;
+      break;
+    case 0x30: // FX30 - LD HF, Vx
+      if constexpr (Mode::superChip) {
+        index = bigFontAddress + (v[x] & 0xF) * 10;
+      }
+      break;
+    case 0x33: // FX33 - LD B, Vx
+      memory[index & addressMask] = v[x] / 100;
+      memory[(index + 1) & addressMask] = (v[x] / 10) % 10;
+      memory[(index + 2) & addressMask] = v[x] % 10;
+      break;
+    case 0x3A: // FX3A - PITCH Vx
+      if constexpr (Mode::xoChip) {
+        pitch = v[x];
+      }
+      break;
+    case 0x55: // FX55 - LD [I], Vx
+      for (int i = 0; i <= x; i++) {
+        memory[(index + i) & addressMask] = v[i];
+      }
+      advanceIndex(x);
+      break;
+    case 0x65: // FX65 - LD Vx, [I]
+      for (int i = 0; i <= x; i++) {
+        v[i] = memory[(index + i) & addressMask];
+      }
+      advanceIndex(x);
+      break;
+    case 0x75: // FX75 - LD R, Vx
+      for (int i = 0; i <= x && i < Mode::flagRegisters; i++) {
+        flags[i] = v[i];
+      }
+      break;
+    case 0x85: // FX85 - LD Vx, R
+      for (int i = 0; i <= x && i < Mode::flagRegisters; i++) {
+        v[i] = flags[i];
+      }
+      break;
+    }
+    break;
+  }
+}
+
+// Every machine under every quirk profile, chip8-headless --mode/--quirks picks one
+template class Chip8Extended<Chip8Classic, Chip8QuirksVip>;
+template class Chip8Extended<Chip8Classic, Chip8QuirksChip48>;
+template class Chip8Extended<Chip8Classic, Chip8QuirksSuperChip>;
+template class Chip8Extended<Chip8Classic, Chip8QuirksModern>;
+template class Chip8Extended<Chip8SuperChip, Chip8QuirksVip>;
+template class Chip8Extended<Chip8SuperChip, Chip8QuirksChip48>;
+template class Chip8Extended<Chip8SuperChip, Chip8QuirksSuperChip>;
+template class Chip8Extended<Chip8SuperChip, Chip8QuirksModern>;
+template class Chip8Extended<Chip8XoChip, Chip8QuirksVip>;
+template class Chip8Extended<Chip8XoChip, Chip8QuirksChip48>;
+template class Chip8Extended<Chip8XoChip, Chip8QuirksSuperChip>;
+template class Chip8Extended<Chip8XoChip, Chip8QuirksModern>;
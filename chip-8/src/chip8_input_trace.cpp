@@ -0,0 +1,134 @@
+#include <cstring>
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+
+#include "chip8_input_trace.h"
+
+namespace {
+  const unsigned char traceMagic[4] = { 'C', '8', 'I', 'T' };
+  const unsigned char traceVersion = 1;
+  const unsigned int traceHeaderSize = 4 + 1 + 8 + 4;
+}
+
+void Chip8InputTrace::record(unsigned long long cycle, unsigned short keyMask) {
+  if (keysAt(cycle) == keyMask) {
+    return;
+  }
+
+  truncate(cycle);
+  events.push_back({ cycle, keyMask });
+}
+
+void Chip8InputTrace::truncate(unsigned long long cycle) {
+  auto first = std::lower_bound(events.begin(), events.end(), cycle, [](const Event &event, unsigned long long c) { return event.cycle < c; });
+  events.erase(first, events.end());
+}
+
+unsigned short Chip8InputTrace::keysAt(unsigned long long cycle) const {
+  // Last event at or before cycle, no keys before the first one
+  auto next = std::upper_bound(events.begin(), events.end(), cycle, [](unsigned long long c, const Event &event) { return c < event.cycle; });
+  return next == events.begin() ? 0 : (next - 1)->keyMask;
+}
+
+void Chip8InputTrace::runCycles(Chip8 &chip8, unsigned long long count) const {
+  unsigned long long end = chip8.getCycles() + count;
+  auto next = std::upper_bound(events.begin(), events.end(), chip8.getCycles(), [](unsigned long long c, const Event &event) { return c < event.cycle; });
+
+  chip8.setKeys(keysAt(chip8.getCycles()));
+  while (chip8.getCycles() < end) {
+    unsigned long long stop = (next != events.end() && next->cycle < end) ? next->cycle : end;
+    chip8.runCycles(stop - chip8.getCycles());
+
+    if (next != events.end() && chip8.getCycles() == next->cycle) {
+      chip8.setKeys(next->keyMask);
+      ++next;
+    }
+  }
+}
+
+std::vector<unsigned char> Chip8InputTrace::serialize() const {
+  std::vector<unsigned char> out(traceMagic, traceMagic + 4);
+  out.push_back(traceVersion);
+  for (int i = 0; i < 8; i++) {
+    out.push_back((unsigned char)(seed >> (i * 8)));
+  }
+  for (int i = 0; i < 4; i++) {
+    out.push_back((unsigned char)(cyclesPerFrame >> (i * 8)));
+  }
+
+  unsigned long long previous = 0;
+  for (const Event &event : events) {
+    unsigned long long delta = event.cycle - previous;
+    previous = event.cycle;
+    do {
+      out.push_back((unsigned char)((delta & 0x7F) | (delta >= 0x80 ? 0x80 : 0)));
+      delta >>= 7;
+    } while (delta);
+    out.push_back((unsigned char)event.keyMask);
+    out.push_back((unsigned char)(event.keyMask >> 8));
+  }
+
+  return out;
+}
+
+bool Chip8InputTrace::deserialize(const std::vector<unsigned char> &data) {
+  if (data.size() < traceHeaderSize || memcmp(data.data(), traceMagic, 4) != 0 || data[4] != traceVersion) {
+    return false;
+  }
+
+  unsigned long long newSeed = 0;
+  for (int i = 0; i < 8; i++) {
+    newSeed |= (unsigned long long)data[5 + i] << (i * 8);
+  }
+  unsigned int newCyclesPerFrame = 0;
+  for (int i = 0; i < 4; i++) {
+    newCyclesPerFrame |= (unsigned int)data[13 + i] << (i * 8);
+  }
+  if (newCyclesPerFrame == 0) {
+    return false;
+  }
+
+  std::vector<Event> newEvents;
+  unsigned long long cycle = 0;
+  size_t position = traceHeaderSize;
+  while (position < data.size()) {
+    unsigned long long delta = 0;
+    int shift = 0;
+    do {
+      if (position >= data.size() || shift > 63) {
+        return false;
+      }
+      delta |= (unsigned long long)(data[position] & 0x7F) << shift;
+      shift += 7;
+    } while (data[position++] & 0x80);
+
+    if (position + 2 > data.size()) {
+      return false;
+    }
+    cycle += delta;
+    newEvents.push_back({ cycle, (unsigned short)(data[position] | (data[position + 1] << 8)) });
+    position += 2;
+  }
+
+  seed = newSeed;
+  cyclesPerFrame = newCyclesPerFrame;
+  events = std::move(newEvents);
+  return true;
+}
+
+bool Chip8InputTrace::save(const char *path) const {
+  std::ofstream file(path, std::ios::binary);
+  std::vector<unsigned char> data = serialize();
+  file.write((const char *)data.data(), data.size());
+  return file.good();
+}
+
+bool Chip8InputTrace::load(const char *path) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file.is_open()) {
+    return false;
+  }
+  std::vector<unsigned char> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+  return deserialize(data);
+}
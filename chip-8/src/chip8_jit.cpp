@@ -0,0 +1,791 @@
+#include <cstring>
+#include <cstddef>
+#include <climits>
+#include <map>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+#include "chip8_jit.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define CHIP8_JIT_X64
+#endif
+
+namespace {
+
+const unsigned int maxBlockInstructions = 64;
+const unsigned long long maxBodyBytes = 8192; // Translation stops once a block body grows past this
+const unsigned long long maxBlockBytes = 16384; // Upper bound for one compiled block, exits included
+const unsigned long long maxBlocks = 65536; // Flush when this many blocks have been compiled
+const unsigned long long pageSize = 4096; // Granularity of the W^X flips, x86-64 pages
+const long long maxBudget = 1LL << 62; // Cycles handed to one chain of blocks at most
+
+// x86-64 register numbers
+enum Reg {
+  RAX = 0, RCX = 1, RDX = 2, RBX = 3, RSP = 4, RBP = 5, RSI = 6, RDI = 7,
+  R8 = 8, R9 = 9, R10 = 10, R11 = 11, R12 = 12, R13 = 13, R14 = 14, R15 = 15
+};
+
+// Condition codes for set() and jumpIf()
+enum Cond {
+  Cond_Equal = 0x4, Cond_NotEqual = 0x5, Cond_Above = 0x7, Cond_Less = 0xC
+};
+
+// The machine pointer lives in RDI, the cycle budget in RDX and RAX/RCX are
+// scratch, CHIP-8 registers are assigned host registers in this order,
+// caller-saved ones first
+#if defined(_WIN32)
+const int allocatable[] = { R8, R9, R10, R11, RSI, RBX, RBP, R12, R13, R14, R15 };
+#else
+const int allocatable[] = { RSI, R8, R9, R10, R11, RBX, RBP, R12, R13, R14, R15 };
+#endif
+const int allocatableCount = sizeof(allocatable) / sizeof(allocatable[0]);
+
+bool isCalleeSaved(int reg) {
+#if defined(_WIN32)
+  if (reg == RSI) {
+    return true;
+  }
+#endif
+  return reg == RBX || reg == RBP || reg >= R12;
+}
+
+// Minimal x86-64 encoder, all register operations are 32-bit
+class Emitter {
+public:
+  std::vector<unsigned char> bytes;
+
+  void byte(unsigned int value) { bytes.push_back(value & 0xFF); }
+  void imm16(unsigned int value) { byte(value); byte(value >> 8); }
+  void imm32(unsigned int value) { imm16(value); imm16(value >> 16); }
+
+  // Only emitted when needed, or always for byte registers so that 4-7 mean SPL-DIL
+  void rex(bool w, int reg, int index, int base, bool force = false) {
+    unsigned char value = 0x40 | (w << 3) | (((reg >> 3) & 1) << 2) | (((index >> 3) & 1) << 1) | ((base >> 3) & 1);
+    if (value != 0x40 || force) {
+      byte(value);
+    }
+  }
+
+  void regOperand(int reg, int rm) { byte(0xC0 | ((reg & 7) << 3) | (rm & 7)); }
+
+  // [rdi + disp32]
+  void memOperand(int reg, int disp) {
+    byte(0x80 | ((reg & 7) << 3) | RDI);
+    imm32(disp);
+  }
+
+  // [rdi + index * (1 << scale) + disp32]
+  void memIndexOperand(int reg, int index, int scale, int disp) {
+    byte(0x84 | ((reg & 7) << 3));
+    byte((scale << 6) | ((index & 7) << 3) | RDI);
+    imm32(disp);
+  }
+
+  void loadByte(int reg, int disp) { rex(false, reg, 0, RDI); byte(0x0F); byte(0xB6); memOperand(reg, disp); }
+  void loadWord(int reg, int disp) { rex(false, reg, 0, RDI); byte(0x0F); byte(0xB7); memOperand(reg, disp); }
+  void loadByteIndexed(int reg, int index, int disp) { rex(false, reg, index, RDI); byte(0x0F); byte(0xB6); memIndexOperand(reg, index, 0, disp); }
+  void loadWordIndexed(int reg, int index, int disp) { rex(false, reg, index, RDI); byte(0x0F); byte(0xB7); memIndexOperand(reg, index, 1, disp); }
+
+  void storeByte(int disp, int reg) { rex(false, reg, 0, RDI, true); byte(0x88); memOperand(reg, disp); }
+  void storeWord(int disp, int reg) { byte(0x66); rex(false, reg, 0, RDI); byte(0x89); memOperand(reg, disp); }
+  void storeWordImm(int disp, unsigned int value) { byte(0x66); byte(0xC7); memOperand(0, disp); imm16(value); }
+  void cmpByteImm(int disp, unsigned int value) { byte(0x80); memOperand(7, disp); byte(value); }
+  void storeWordImmIndexed(int index, int disp, unsigned int value) {
+    byte(0x66);
+    rex(false, 0, index, RDI);
+    byte(0xC7);
+    memIndexOperand(0, index, 1, disp);
+    imm16(value);
+  }
+
+  void movImm(int reg, unsigned int value) { rex(false, 0, 0, reg); byte(0xB8 + (reg & 7)); imm32(value); }
+
+  // op r/m32, r32
+  void alu(unsigned char opcode, int dst, int src) { rex(false, src, 0, dst); byte(opcode); regOperand(src, dst); }
+  void mov(int dst, int src) { alu(0x89, dst, src); }
+  void add(int dst, int src) { alu(0x01, dst, src); }
+  void orReg(int dst, int src) { alu(0x09, dst, src); }
+  void andReg(int dst, int src) { alu(0x21, dst, src); }
+  void sub(int dst, int src) { alu(0x29, dst, src); }
+  void xorReg(int dst, int src) { alu(0x31, dst, src); }
+  void cmp(int dst, int src) { alu(0x39, dst, src); }
+
+  // op r/m32, imm32
+  void aluImm(int extension, int dst, unsigned int value) { rex(false, 0, 0, dst); byte(0x81); regOperand(extension, dst); imm32(value); }
+  void addImm(int dst, unsigned int value) { aluImm(0, dst, value); }
+  void subImm(int dst, unsigned int value) { aluImm(5, dst, value); }
+  void andImm(int dst, unsigned int value) { aluImm(4, dst, value); }
+  void cmpImm(int dst, unsigned int value) { aluImm(7, dst, value); }
+
+  void shl(int reg, int amount) { rex(false, 0, 0, reg); byte(0xC1); regOperand(4, reg); byte(amount); }
+  void shr(int reg, int amount) { rex(false, 0, 0, reg); byte(0xC1); regOperand(5, reg); byte(amount); }
+
+  void test(int dst, int src) { alu(0x85, dst, src); }
+  void set(int cond, int reg) { byte(0x0F); byte(0x90 + cond); regOperand(0, reg); } // RAX-RDX only
+  void setAbove(int reg) { set(Cond_Above, reg); }
+  void imulImm(int dst, int src, int value) { rex(false, dst, 0, src); byte(0x6B); regOperand(dst, src); byte(value); }
+
+  void push(int reg) { rex(false, 0, 0, reg); byte(0x50 + (reg & 7)); }
+  void pop(int reg) { rex(false, 0, 0, reg); byte(0x58 + (reg & 7)); }
+  void mov64(int dst, int src) { rex(true, src, 0, dst); byte(0x89); regOperand(src, dst); }
+  void add64(int dst, int src) { rex(true, src, 0, dst); byte(0x01); regOperand(src, dst); }
+  void subImm64(int dst, unsigned int value) { rex(true, 0, 0, dst); byte(0x81); regOperand(5, dst); imm32(value); }
+  void movImm64(int reg, unsigned long long value) { rex(true, 0, 0, reg); byte(0xB8 + (reg & 7)); imm32((unsigned int)value); imm32((unsigned int)(value >> 32)); }
+  void ret() { byte(0xC3); }
+
+  // Addressing through a base other than RDI, which must not be RSP, RBP, R12 or R13
+  void loadWordFrom(int reg, int base, int disp) { rex(false, reg, 0, base); byte(0x0F); byte(0xB7); byte(0x80 | ((reg & 7) << 3) | (base & 7)); imm32(disp); }
+  void cmpMem64(int reg, int base, int disp) { rex(true, reg, 0, base); byte(0x3B); byte(0x40 | ((reg & 7) << 3) | (base & 7)); byte(disp); } // cmp reg, [base + disp8]
+  void jumpMem(int base) { rex(false, 0, 0, base); byte(0xFF); byte(0x20 | (base & 7)); } // jmp [base]
+
+  // Forward jumps, the returned position is patched by bind()
+  size_t jump() { byte(0xE9); imm32(0); return bytes.size() - 4; }
+  size_t jumpIf(int cond) { byte(0x0F); byte(0x80 + cond); imm32(0); return bytes.size() - 4; }
+  void bind(size_t at) {
+    unsigned int offset = (unsigned int)(bytes.size() - (at + 4));
+    for (int i = 0; i < 4; i++) {
+      bytes[at + i] = (offset >> (i * 8)) & 0xFF;
+    }
+  }
+};
+
+// Wait loops that Chip8::skipIdle() fast-forwards, by their code alone. Blocks
+// starting on one are not chained to, so runCycles() gets to skip them.
+bool isWaitLoop(const unsigned char *memory, unsigned short address) {
+  unsigned short opcode = (memory[address] << 8) | memory[(address + 1) & 0xFFF];
+  if (opcode == (0x1000 | address) || (opcode & 0xF0FF) == 0xF00A) {
+    return true;
+  }
+  if ((opcode & 0xF0FF) != 0xF007 || address > 0xFFA) {
+    return false;
+  }
+  unsigned short test = (memory[address + 2] << 8) | memory[address + 3];
+  unsigned short jump = (memory[address + 4] << 8) | memory[address + 5];
+  return jump == (0x1000 | address) && (test & 0x0F00) == (opcode & 0x0F00) && ((test & 0xF000) == 0x3000 || (test & 0xF000) == 0x4000);
+}
+
+}
+
+Chip8Jit::Chip8Jit(unsigned long long codeBufferSize) : codeBufferSize(codeBufferSize), codeBufferUsed(0) {
+  codeBuffer = nullptr;
+
+#if defined(CHIP8_JIT_X64)
+  // Writable and not executable until blocks are placed, see protect()
+#if defined(_WIN32)
+  codeBuffer = (unsigned char *)VirtualAlloc(NULL, codeBufferSize, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+#else
+  void *memory = mmap(NULL, codeBufferSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  codeBuffer = memory == MAP_FAILED ? nullptr : (unsigned char *)memory;
+#endif
+#endif
+
+  flush();
+}
+
+Chip8Jit::~Chip8Jit() {
+  if (codeBuffer == nullptr) {
+    return;
+  }
+
+#if defined(_WIN32)
+  VirtualFree(codeBuffer, 0, MEM_RELEASE);
+#else
+  munmap(codeBuffer, codeBufferSize);
+#endif
+}
+
+bool Chip8Jit::isSupported() {
+#if defined(CHIP8_JIT_X64)
+  return true;
+#else
+  return false;
+#endif
+}
+
+void Chip8Jit::flush() {
+  blocks.clear();
+  codeBufferUsed = 0;
+  for (int i = 0; i < 4096; i++) {
+    blockAt[i] = -1;
+    links[i] = { nullptr, LLONG_MAX };
+  }
+  memset(codeBytes, 0, sizeof(codeBytes));
+}
+
+void Chip8Jit::protect(unsigned long long offset, unsigned long long size, bool writable) {
+  // Whole pages, a block may share its first page with the one before it
+  unsigned long long first = offset & ~(pageSize - 1);
+  unsigned long long last = (offset + size + pageSize - 1) & ~(pageSize - 1);
+#if defined(_WIN32)
+  DWORD previous;
+  VirtualProtect(codeBuffer + first, last - first, writable ? PAGE_READWRITE : PAGE_EXECUTE_READ, &previous);
+  if (!writable) {
+    FlushInstructionCache(GetCurrentProcess(), codeBuffer + first, last - first);
+  }
+#else
+  mprotect(codeBuffer + first, last - first, writable ? PROT_READ | PROT_WRITE : PROT_READ | PROT_EXEC);
+#endif
+}
+
+void Chip8Jit::invalidate(unsigned short address) {
+  address &= 0xFFF;
+  if (codeBytes[address] == 0) {
+    return;
+  }
+
+  for (Block &block : blocks) {
+    if (block.instructionCount == 0 || address < block.start || address >= block.end) {
+      continue;
+    }
+
+    for (int i = block.start; i < block.end; i++) {
+      codeBytes[i]--;
+    }
+    blockAt[block.start] = -1;
+    links[block.start] = { nullptr, LLONG_MAX };
+    block.instructionCount = 0;
+    block.code = nullptr;
+  }
+}
+
+int Chip8Jit::compile(const Chip8 &chip8, unsigned short start) {
+  if (blocks.size() >= maxBlocks || codeBufferUsed + maxBlockBytes > codeBufferSize) {
+    flush();
+  }
+
+  const int vOffset = offsetof(Chip8, v);
+  const int pcOffset = offsetof(Chip8, pc);
+  const int indexOffset = offsetof(Chip8, index);
+  const int spOffset = offsetof(Chip8, sp);
+  const int stackOffset = offsetof(Chip8, stack);
+  const int memoryOffset = offsetof(Chip8, memory);
+  const int delayTimerOffset = offsetof(Chip8, delayTimer);
+  const int keysOffset = offsetof(Chip8, keys);
+
+  Emitter body;
+
+  // -- Register allocation, V registers stay in host registers for the whole block --
+  int host[16];
+  bool dirty[16];
+  int used = 0;
+  for (int i = 0; i < 16; i++) {
+    host[i] = -1;
+    dirty[i] = false;
+  }
+
+  auto fits = [&](unsigned int registerMask) {
+    int needed = used;
+    for (int i = 0; i < 16; i++) {
+      if ((registerMask >> i) & 1 && host[i] < 0) {
+        needed++;
+      }
+    }
+    return needed <= allocatableCount;
+  };
+
+  auto reg = [&](int x) {
+    if (host[x] < 0) {
+      host[x] = allocatable[used++];
+      body.loadByte(host[x], vOffset + x);
+    }
+    return host[x];
+  };
+
+  auto write = [&](int x) {
+    int r = reg(x);
+    dirty[x] = true;
+    return r;
+  };
+
+  // -- Exits. Each one writes back what is dirty at that point, takes the
+  // instructions it ran off the budget and jumps to a stub after the body
+  // that chains to the next block --
+  std::map<int, std::vector<size_t>> exits; // Jumps to patch by target, -1 when pc is only known at run time
+
+  auto exit = [&](int target, unsigned int executed) {
+    for (int k = 0; k < 16; k++) {
+      if (dirty[k]) {
+        body.storeByte(vOffset + k, host[k]);
+      }
+    }
+    body.subImm64(RDX, executed);
+    exits[target].push_back(body.jump());
+  };
+
+  // -- Instruction classes --
+  enum Kind { Kind_Unsupported, Kind_Plain, Kind_Skip, Kind_Exit };
+
+  auto classify = [](const Chip8::Instruction &i, unsigned int &registers) {
+    const unsigned int x = 1u << i.x, y = 1u << i.y, f = 1u << 0xF;
+    registers = 0;
+
+    switch (i.op) {
+    case Chip8::Op_LD_BYTE: case Chip8::Op_ADD_BYTE: case Chip8::Op_LD_VX_DT: case Chip8::Op_LD_DT_VX:
+    case Chip8::Op_LD_FONT: case Chip8::Op_LD_VX_KEY:
+      registers = x;
+      return Kind_Plain;
+    case Chip8::Op_LD_REG: case Chip8::Op_OR_REG: case Chip8::Op_AND_REG: case Chip8::Op_XOR_REG:
+      registers = x | y;
+      return Kind_Plain;
+    case Chip8::Op_ADD_REG: case Chip8::Op_SUB_REG: case Chip8::Op_SUBN:
+      registers = x | y | f;
+      return Kind_Plain;
+    case Chip8::Op_SHR: case Chip8::Op_SHL: case Chip8::Op_ADD_INDEX:
+      registers = x | f;
+      return Kind_Plain;
+    case Chip8::Op_LOAD_REGS:
+      registers = (2u << i.x) - 1;
+      return Kind_Plain;
+    case Chip8::Op_NOP: case Chip8::Op_LD_INDEX:
+      return Kind_Plain;
+    case Chip8::Op_SE_BYTE: case Chip8::Op_SNE_BYTE: case Chip8::Op_SKP: case Chip8::Op_SKNP:
+      registers = x;
+      return Kind_Skip;
+    case Chip8::Op_SE_REG: case Chip8::Op_SNE_REG:
+      registers = x | y;
+      return Kind_Skip;
+    case Chip8::Op_JP_OFFSET:
+      registers = 1;
+      return Kind_Exit;
+    case Chip8::Op_JP: case Chip8::Op_CALL: case Chip8::Op_RET:
+      return Kind_Exit;
+    default:
+      return Kind_Unsupported; // Interpreted
+    }
+  };
+
+  // Compares for a skip, returns the condition under which it is taken
+  auto compare = [&](const Chip8::Instruction &i) {
+    if (i.op == Chip8::Op_SKP || i.op == Chip8::Op_SKNP) {
+      // keys[Vx & 0xF], leaving RAX alone
+      body.mov(RCX, reg(i.x));
+      body.andImm(RCX, 0xF);
+      body.loadByteIndexed(RCX, RCX, keysOffset);
+      body.test(RCX, RCX);
+      return i.op == Chip8::Op_SKP ? Cond_NotEqual : Cond_Equal;
+    }
+    if (i.op == Chip8::Op_SE_BYTE || i.op == Chip8::Op_SNE_BYTE) {
+      body.cmpImm(reg(i.x), i.nn);
+    }
+    else {
+      body.cmp(reg(i.x), reg(i.y));
+    }
+    return (i.op == Chip8::Op_SE_BYTE || i.op == Chip8::Op_SE_REG) ? Cond_Equal : Cond_NotEqual;
+  };
+
+  // Plain and exit instructions. next is the address after i, executed the
+  // instructions run up to and including i when no skip was taken.
+  auto emit = [&](const Chip8::Instruction &i, unsigned short next, unsigned int executed) {
+    switch (i.op) {
+    case Chip8::Op_NOP:
+      break;
+
+    case Chip8::Op_LD_BYTE: // 6XNN
+      body.movImm(write(i.x), i.nn);
+      break;
+
+    case Chip8::Op_ADD_BYTE: // 7XNN
+      body.addImm(write(i.x), i.nn);
+      body.andImm(reg(i.x), 0xFF);
+      break;
+
+    case Chip8::Op_LD_REG: // 8XY0
+      body.mov(write(i.x), reg(i.y));
+      break;
+
+    case Chip8::Op_OR_REG: // 8XY1
+      body.orReg(write(i.x), reg(i.y));
+      break;
+
+    case Chip8::Op_AND_REG: // 8XY2
+      body.andReg(write(i.x), reg(i.y));
+      break;
+
+    case Chip8::Op_XOR_REG: // 8XY3
+      body.xorReg(write(i.x), reg(i.y));
+      break;
+
+    case Chip8::Op_ADD_REG: // 8XY4, VF is written before Vx like the interpreter
+      body.mov(RAX, reg(i.x));
+      body.add(RAX, reg(i.y));
+      body.shr(RAX, 8);
+      body.mov(write(0xF), RAX);
+      body.add(write(i.x), reg(i.y));
+      body.andImm(reg(i.x), 0xFF);
+      break;
+
+    case Chip8::Op_SUB_REG: // 8XY5
+      body.xorReg(RAX, RAX);
+      body.cmp(reg(i.x), reg(i.y));
+      body.setAbove(RAX);
+      body.mov(write(0xF), RAX);
+      body.sub(write(i.x), reg(i.y));
+      body.andImm(reg(i.x), 0xFF);
+      break;
+
+    case Chip8::Op_SHR: // 8XY6
+      body.mov(RAX, reg(i.x));
+      body.andImm(RAX, 1);
+      body.mov(write(0xF), RAX);
+      body.shr(write(i.x), 1);
+      break;
+
+    case Chip8::Op_SUBN: // 8XY7
+      body.xorReg(RAX, RAX);
+      body.cmp(reg(i.y), reg(i.x));
+      body.setAbove(RAX);
+      body.mov(write(0xF), RAX);
+      body.mov(RCX, reg(i.y));
+      body.sub(RCX, reg(i.x));
+      body.andImm(RCX, 0xFF);
+      body.mov(write(i.x), RCX);
+      break;
+
+    case Chip8::Op_SHL: // 8XYE
+      body.mov(RAX, reg(i.x));
+      body.shr(RAX, 7);
+      body.mov(write(0xF), RAX);
+      body.shl(write(i.x), 1);
+      body.andImm(reg(i.x), 0xFF);
+      break;
+
+    case Chip8::Op_LD_INDEX: // ANNN
+      body.storeWordImm(indexOffset, i.nnn);
+      break;
+
+    case Chip8::Op_ADD_INDEX: // FX1E
+      body.loadWord(RAX, indexOffset);
+      body.add(RAX, reg(i.x));
+      body.andImm(RAX, 0xFFFF);
+      body.storeWord(indexOffset, RAX);
+      body.xorReg(RCX, RCX);
+      body.cmpImm(RAX, 0xFFF);
+      body.setAbove(RCX);
+      body.mov(write(0xF), RCX);
+      break;
+
+    case Chip8::Op_LD_VX_DT: // FX07
+      body.loadByte(write(i.x), delayTimerOffset);
+      break;
+
+    case Chip8::Op_LD_DT_VX: // FX15
+      body.storeByte(delayTimerOffset, reg(i.x));
+      break;
+
+    case Chip8::Op_LD_VX_KEY: { // FX0A, the lowest held key but F, or an exit back to itself
+      int r = write(i.x);
+      std::vector<size_t> held;
+      for (int k = 0; k < 0xF; k++) {
+        body.cmpByteImm(keysOffset + k, 0);
+        held.push_back(body.jumpIf(Cond_NotEqual));
+      }
+      body.storeWordImm(pcOffset, next - 2);
+      exit(next - 2, executed);
+
+      std::vector<size_t> done;
+      for (int k = 0; k < 0xF; k++) {
+        body.bind(held[k]);
+        body.movImm(r, k);
+        done.push_back(body.jump());
+      }
+      for (size_t at : done) {
+        body.bind(at);
+      }
+      break;
+    }
+
+    case Chip8::Op_LD_FONT: // FX29
+      body.imulImm(RAX, reg(i.x), 5);
+      body.addImm(RAX, 0x50);
+      body.storeWord(indexOffset, RAX);
+      break;
+
+    case Chip8::Op_LOAD_REGS: // FX65
+      body.loadWord(RAX, indexOffset);
+      for (int k = 0; k <= i.x; k++) {
+        int r = write(k);
+        body.mov(RCX, RAX);
+        body.addImm(RCX, k);
+        body.andImm(RCX, 0xFFF);
+        body.loadByteIndexed(r, RCX, memoryOffset);
+      }
+      break;
+
+    case Chip8::Op_JP: // 1NNN
+      body.storeWordImm(pcOffset, i.nnn);
+      exit(i.nnn, executed);
+      break;
+
+    case Chip8::Op_CALL: // 2NNN
+      body.loadWord(RAX, spOffset);
+      body.addImm(RAX, 1);
+      body.andImm(RAX, 0xF);
+      body.storeWord(spOffset, RAX);
+      body.storeWordImmIndexed(RAX, stackOffset, next);
+      body.storeWordImm(pcOffset, i.nnn);
+      exit(i.nnn, executed);
+      break;
+
+    case Chip8::Op_RET: // 00EE
+      body.loadWord(RAX, spOffset);
+      body.loadWordIndexed(RCX, RAX, stackOffset);
+      body.storeWord(pcOffset, RCX);
+      body.subImm(RAX, 1);
+      body.andImm(RAX, 0xF);
+      body.storeWord(spOffset, RAX);
+      exit(-1, executed);
+      break;
+
+    case Chip8::Op_JP_OFFSET: // BNNN
+      body.mov(RAX, reg(0));
+      body.addImm(RAX, i.nnn);
+      body.storeWord(pcOffset, RAX);
+      exit(-1, executed);
+      break;
+
+    default:
+      break;
+    }
+  };
+
+  // -- Translate until an exit or an unsupported instruction --
+  unsigned short address = start;
+  unsigned int count = 0; // Instructions on the longest path
+  bool terminated = false;
+
+  while (!terminated && count < maxBlockInstructions && address <= 0xFFE && body.bytes.size() < maxBodyBytes) {
+    unsigned short opcode = (chip8.memory[address] << 8) | chip8.memory[address + 1];
+    Chip8::Instruction i = Chip8::decode(opcode);
+    unsigned short next = address + 2;
+
+    unsigned int registers;
+    Kind kind = classify(i, registers);
+    if (kind == Kind_Unsupported || !fits(registers)) {
+      break;
+    }
+
+    if (kind != Kind_Skip) {
+      count++;
+      emit(i, next, count);
+      address = next;
+      terminated = kind == Kind_Exit;
+      continue;
+    }
+
+    // A skip over an instruction the block can hold branches around it and
+    // the block goes on, a skipped jump becomes an exit on the other path
+    unsigned int skippedRegisters = 0;
+    Kind skippedKind = Kind_Unsupported;
+    Chip8::Instruction skipped = {};
+    if (next <= 0xFFE) {
+      skipped = Chip8::decode((chip8.memory[next] << 8) | chip8.memory[next + 1]);
+      skippedKind = classify(skipped, skippedRegisters);
+    }
+
+    if ((skippedKind == Kind_Plain || skippedKind == Kind_Exit) && count + 2 <= maxBlockInstructions && fits(registers | skippedRegisters)) {
+      // Loaded up front, so both paths agree on what the host registers hold
+      for (int k = 0; k < 16; k++) {
+        if (((registers | skippedRegisters) >> k) & 1) {
+          reg(k);
+        }
+      }
+
+      body.xorReg(RAX, RAX);
+      body.set(compare(i), RAX);
+      body.add64(RDX, RAX); // A taken skip runs one instruction less
+      body.test(RAX, RAX);
+      size_t over = body.jumpIf(Cond_NotEqual);
+      emit(skipped, next + 2, count + 2);
+      body.bind(over);
+
+      count += 2;
+      address = next + 2;
+      continue;
+    }
+
+    // Otherwise the block ends on the skip, with an exit for either outcome
+    count++;
+    size_t taken = body.jumpIf(compare(i));
+    body.storeWordImm(pcOffset, next);
+    exit(next, count);
+    body.bind(taken);
+    body.storeWordImm(pcOffset, next + 2);
+    exit(next + 2, count);
+    address = next;
+    terminated = true;
+  }
+
+  Block block = { start, address, count, nullptr };
+
+  if (count > 0) {
+    if (!terminated) {
+      body.storeWordImm(pcOffset, address);
+      exit(address, count);
+    }
+
+    // -- Exit stubs: restore the caller's registers, then chain to the next
+    // block if it is compiled and fits in the budget, or return the budget --
+#if defined(_WIN32)
+    const int machine = RCX;
+#else
+    const int machine = RDI;
+#endif
+    for (auto &[target, jumps] : exits) {
+      for (size_t at : jumps) {
+        body.bind(at);
+      }
+
+      for (int i = used - 1; i >= 0; i--) {
+        if (isCalleeSaved(allocatable[i])) {
+          body.pop(allocatable[i]);
+        }
+      }
+#if defined(_WIN32)
+      body.mov64(RCX, RDI);
+      body.pop(RDI);
+#endif
+
+      std::vector<size_t> returns;
+      if (target < 0) {
+        body.loadWordFrom(RAX, machine, pcOffset);
+        body.cmpImm(RAX, 0xFFF);
+        returns.push_back(body.jumpIf(Cond_Above));
+        body.shl(RAX, 4);
+        body.movImm64(R11, (unsigned long long)links);
+        body.add64(RAX, R11);
+      }
+      else if (target < 0x1000) {
+        body.movImm64(RAX, (unsigned long long)&links[target]);
+      }
+      if (target < 0x1000) {
+        body.cmpMem64(RDX, RAX, offsetof(Link, instructionCount));
+        returns.push_back(body.jumpIf(Cond_Less));
+        body.jumpMem(RAX);
+      }
+
+      for (size_t at : returns) {
+        body.bind(at);
+      }
+      body.mov64(RAX, RDX);
+      body.ret();
+    }
+
+    // -- Prologue --
+    Emitter code;
+#if defined(_WIN32)
+    code.push(RDI);
+    code.mov64(RDI, RCX);
+#else
+    code.mov64(RDX, RSI); // The budget, skipped when chaining since it is already in place
+#endif
+    size_t chainedEntry = code.bytes.size();
+    for (int i = 0; i < used; i++) {
+      if (isCalleeSaved(allocatable[i])) {
+        code.push(allocatable[i]);
+      }
+    }
+    code.bytes.insert(code.bytes.end(), body.bytes.begin(), body.bytes.end());
+
+#if defined(_WIN32)
+    // Chaining passes the machine in RCX, so Windows re-runs the whole prologue
+    chainedEntry = 0;
+#endif
+
+    protect(codeBufferUsed, code.bytes.size(), true);
+    memcpy(codeBuffer + codeBufferUsed, code.bytes.data(), code.bytes.size());
+    protect(codeBufferUsed, code.bytes.size(), false);
+
+    block.code = (BlockFunction)(codeBuffer + codeBufferUsed);
+    if (!chip8.idleSkipping || !isWaitLoop(chip8.memory, start)) {
+      links[start] = { codeBuffer + codeBufferUsed + chainedEntry, count };
+    }
+    codeBufferUsed += (code.bytes.size() + 15) & ~15ULL;
+
+    for (int i = block.start; i < block.end; i++) {
+      codeBytes[i]++;
+    }
+  }
+
+  blocks.push_back(block);
+  blockAt[start] = (int)blocks.size() - 1;
+  return blockAt[start];
+}
+
+void Chip8Jit::precompile(const Chip8 &chip8, std::span<const unsigned short> starts) {
+  if (codeBuffer == nullptr) {
+    return;
+  }
+
+  for (unsigned short start : starts) {
+    // Stop rather than let compile() flush what was just built
+    if (blocks.size() >= maxBlocks || codeBufferUsed + maxBlockBytes > codeBufferSize) {
+      break;
+    }
+    if (start < 0x1000 && blockAt[start] < 0) {
+      compile(chip8, start);
+    }
+  }
+}
+
+void Chip8Jit::runCycles(Chip8 &chip8, unsigned long long count) {
+  if (codeBuffer == nullptr) {
+    chip8.runCycles(count);
+    return;
+  }
+
+  while (count > 0) {
+    // Wait loops are fast-forwarded exactly as Chip8::runCycles() does. Block
+    // starts always fall on the FX07 of a loop, so no aligning is needed, and
+    // only FX07, FX0A and 1NNN can start one.
+    unsigned char high = chip8.memory[chip8.pc & 0xFFF] & 0xF0;
+    if (high == 0xF0 || high == 0x10) {
+      count -= chip8.skipIdle(count);
+      if (count == 0) {
+        break;
+      }
+    }
+
+    // Blocks assume an in-range pc so that the stored return addresses match the interpreter
+    if (chip8.pc < 0x1000) {
+      int blockIndex = blockAt[chip8.pc];
+      if (blockIndex < 0) {
+        blockIndex = compile(chip8, chip8.pc);
+      }
+
+      // The block chains on to the blocks after it while the budget lasts
+      const Block &block = blocks[blockIndex];
+      if (block.instructionCount > 0 && block.instructionCount <= count) {
+        long long budget = count < (unsigned long long)maxBudget ? (long long)count : maxBudget;
+        unsigned long long executed = budget - block.code(&chip8, budget);
+        chip8.cycles += executed;
+        count -= executed;
+        continue;
+      }
+    }
+
+    // Interpret one instruction, dropping compiled blocks it overwrites
+    unsigned short address = chip8.pc & 0xFFF;
+    unsigned short opcode = (chip8.memory[address] << 8) | chip8.memory[(address + 1) & 0xFFF];
+    unsigned short writeStart = chip8.index;
+    int writeCount = 0;
+    if ((opcode & 0xF0FF) == 0xF033) {
+      writeCount = 3;
+    }
+    if ((opcode & 0xF0FF) == 0xF055) {
+      writeCount = ((opcode >> 8) & 0xF) + 1;
+    }
+
+    chip8.runPredecoded(1);
+    count--;
+
+    for (int i = 0; i < writeCount; i++) {
+      invalidate(writeStart + i);
+    }
+  }
+}
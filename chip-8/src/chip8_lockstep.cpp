@@ -0,0 +1,667 @@
+#include <cstring>
+#include <algorithm>
+#include <bit>
+
+// On x86-64 the AVX2 kernels below are compiled for AVX2 on their own and
+// only called when the CPU has it, everything else stays baseline x86-64
+#if defined(__x86_64__) || defined(_M_X64)
+#define CHIP8_HAVE_AVX2
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define CHIP8_AVX2_TARGET
+#else
+#define CHIP8_AVX2_TARGET __attribute__((target("avx2")))
+#endif
+#endif
+
+#include "chip8.h"
+#include "chip8_lockstep.h"
+
+// Byte-wise register operations, applied to every active lane. scalar() is
+// the reference, vector() does the same for 32 lanes at once.
+#if defined(CHIP8_HAVE_AVX2)
+#define CHIP8_LANE_OP(name, scalarExpression, vectorExpression)                                        \
+  struct name {                                                                                        \
+    static unsigned char scalar(unsigned char a, unsigned char b) { return (unsigned char)(scalarExpression); } \
+    CHIP8_AVX2_TARGET static __m256i vector(__m256i a, __m256i b) { return vectorExpression; }         \
+  };
+#else
+#define CHIP8_LANE_OP(name, scalarExpression, vectorExpression)                                        \
+  struct name {                                                                                        \
+    static unsigned char scalar(unsigned char a, unsigned char b) { return (unsigned char)(scalarExpression); } \
+  };
+#endif
+
+namespace {
+  CHIP8_LANE_OP(LaneMove, b, b)
+  CHIP8_LANE_OP(LaneOr, a | b, _mm256_or_si256(a, b))
+  CHIP8_LANE_OP(LaneAnd, a & b, _mm256_and_si256(a, b))
+  CHIP8_LANE_OP(LaneXor, a ^ b, _mm256_xor_si256(a, b))
+  CHIP8_LANE_OP(LaneAdd, a + b, _mm256_add_epi8(a, b))
+  CHIP8_LANE_OP(LaneSub, a - b, _mm256_sub_epi8(a, b))
+  CHIP8_LANE_OP(LaneSubReverse, b - a, _mm256_sub_epi8(b, a))
+  CHIP8_LANE_OP(LaneShiftRight, a >> 1, _mm256_and_si256(_mm256_srli_epi16(a, 1), _mm256_set1_epi8(0x7F)))
+  CHIP8_LANE_OP(LaneShiftLeft, a << 1, _mm256_add_epi8(a, a))
+  CHIP8_LANE_OP(LaneLowBit, a & 1, _mm256_and_si256(a, _mm256_set1_epi8(1)))
+  CHIP8_LANE_OP(LaneHighBit, a >> 7, _mm256_and_si256(_mm256_srli_epi16(a, 7), _mm256_set1_epi8(1)))
+
+  // 1 if a + b overflows: the saturating and wrapping sums only differ on overflow
+  CHIP8_LANE_OP(LaneCarry, (int)a + (int)b > 255,
+    _mm256_andnot_si256(_mm256_cmpeq_epi8(_mm256_adds_epu8(a, b), _mm256_add_epi8(a, b)), _mm256_set1_epi8(1)))
+
+  // 1 if a > b unsigned: max(a, b) == b exactly when a <= b
+  CHIP8_LANE_OP(LaneGreater, a > b,
+    _mm256_andnot_si256(_mm256_cmpeq_epi8(_mm256_max_epu8(a, b), b), _mm256_set1_epi8(1)))
+
+  CHIP8_LANE_OP(LaneEqual, a == b, _mm256_and_si256(_mm256_cmpeq_epi8(a, b), _mm256_set1_epi8(1)))
+  CHIP8_LANE_OP(LaneNotEqual, a != b, _mm256_andnot_si256(_mm256_cmpeq_epi8(a, b), _mm256_set1_epi8(1)))
+}
+
+#undef CHIP8_LANE_OP
+
+#if defined(CHIP8_HAVE_AVX2)
+namespace {
+  bool cpuHasAVX2() {
+#if defined(_MSC_VER) && !defined(__clang__)
+    int info[4];
+    __cpuid(info, 1);
+    bool osSavesYmm = (info[2] & (1 << 27)) && (_xgetbv(0) & 6) == 6; // OSXSAVE, then XMM and YMM state enabled
+    __cpuidex(info, 7, 0);
+    return osSavesYmm && (info[1] & (1 << 5));
+#else
+    return __builtin_cpu_supports("avx2");
+#endif
+  }
+
+  // The kernels cover whole 16 or 32 lane steps and return the first lane
+  // they did not handle, the scalar loop of the caller finishes the rest.
+  // Lane arrays are padded to laneBlock, so lowestPC and selectLanes always
+  // cover every lane.
+
+  CHIP8_AVX2_TARGET unsigned short lowestPCAVX2(const unsigned short *pc, const unsigned short *remaining, unsigned int laneCount) {
+    // Lanes without budget become 0xFFFF, then it is an unsigned 16-bit min
+    __m256i lowestVector = _mm256_set1_epi16(-1);
+    for (unsigned int lane = 0; lane < laneCount; lane += 16) {
+      __m256i idle = _mm256_cmpeq_epi16(_mm256_loadu_si256((const __m256i *)&remaining[lane]), _mm256_setzero_si256());
+      __m256i key = _mm256_or_si256(_mm256_loadu_si256((const __m256i *)&pc[lane]), idle);
+      lowestVector = _mm256_min_epu16(lowestVector, key);
+    }
+    __m128i half = _mm_min_epu16(_mm256_castsi256_si128(lowestVector), _mm256_extracti128_si256(lowestVector, 1));
+    return (unsigned short)_mm_extract_epi16(_mm_minpos_epu16(half), 0);
+  }
+
+  CHIP8_AVX2_TARGET unsigned int selectLanesAVX2(unsigned short address, const unsigned short *pc, unsigned short *remaining, unsigned char *active, unsigned int laneCount) {
+    unsigned int lanes = 0;
+    __m256i target = _mm256_set1_epi16((short)address);
+    for (unsigned int lane = 0; lane < laneCount; lane += 32) {
+      __m256i remaining0 = _mm256_loadu_si256((const __m256i *)&remaining[lane]);
+      __m256i remaining1 = _mm256_loadu_si256((const __m256i *)&remaining[lane + 16]);
+      __m256i runs0 = _mm256_andnot_si256(_mm256_cmpeq_epi16(remaining0, _mm256_setzero_si256()),
+        _mm256_cmpeq_epi16(_mm256_loadu_si256((const __m256i *)&pc[lane]), target));
+      __m256i runs1 = _mm256_andnot_si256(_mm256_cmpeq_epi16(remaining1, _mm256_setzero_si256()),
+        _mm256_cmpeq_epi16(_mm256_loadu_si256((const __m256i *)&pc[lane + 16]), target));
+
+      // runs is all ones where the lane runs, adding it charges one cycle
+      _mm256_storeu_si256((__m256i *)&remaining[lane], _mm256_add_epi16(remaining0, runs0));
+      _mm256_storeu_si256((__m256i *)&remaining[lane + 16], _mm256_add_epi16(remaining1, runs1));
+
+      // Narrow the 16-bit masks to bytes, packs works per 128-bit half so fix the order after
+      __m256i mask = _mm256_permute4x64_epi64(_mm256_packs_epi16(runs0, runs1), 0xD8);
+      _mm256_storeu_si256((__m256i *)&active[lane], mask);
+      lanes += std::popcount((unsigned int)_mm256_movemask_epi8(mask));
+    }
+    return lanes;
+  }
+
+  CHIP8_AVX2_TARGET unsigned int advancePCAVX2(unsigned short *pc, const unsigned char *active, unsigned int first, unsigned int last) {
+    unsigned int lane = first;
+    for (; lane + 16 <= last; lane += 16) {
+      __m256i step = _mm256_and_si256(_mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i *)&active[lane])), _mm256_set1_epi16(2));
+      __m256i value = _mm256_loadu_si256((const __m256i *)&pc[lane]);
+      _mm256_storeu_si256((__m256i *)&pc[lane], _mm256_add_epi16(value, step));
+    }
+    return lane;
+  }
+
+  template <typename LaneOp>
+  CHIP8_AVX2_TARGET unsigned int applyBytesAVX2(unsigned char *dst, const unsigned char *a, const unsigned char *b, const unsigned char *active, unsigned int first, unsigned int last) {
+    unsigned int lane = first;
+    for (; lane + 32 <= last; lane += 32) {
+      __m256i mask = _mm256_loadu_si256((const __m256i *)&active[lane]);
+      __m256i result = LaneOp::vector(_mm256_loadu_si256((const __m256i *)(a + lane)), _mm256_loadu_si256((const __m256i *)(b + lane)));
+      __m256i old = _mm256_loadu_si256((const __m256i *)(dst + lane));
+      _mm256_storeu_si256((__m256i *)(dst + lane), _mm256_blendv_epi8(old, result, mask));
+    }
+    return lane;
+  }
+
+  template <typename LaneOp>
+  CHIP8_AVX2_TARGET unsigned int applyImmediateAVX2(unsigned char *dst, const unsigned char *a, unsigned char immediate, const unsigned char *active, unsigned int first, unsigned int last) {
+    unsigned int lane = first;
+    __m256i b = _mm256_set1_epi8((char)immediate);
+    for (; lane + 32 <= last; lane += 32) {
+      __m256i mask = _mm256_loadu_si256((const __m256i *)&active[lane]);
+      __m256i result = LaneOp::vector(_mm256_loadu_si256((const __m256i *)(a + lane)), b);
+      __m256i old = _mm256_loadu_si256((const __m256i *)(dst + lane));
+      _mm256_storeu_si256((__m256i *)(dst + lane), _mm256_blendv_epi8(old, result, mask));
+    }
+    return lane;
+  }
+}
+#endif
+
+Chip8Lockstep::Chip8Lockstep(const unsigned char *gameBinaryData, unsigned int gameBinaryDataSize, unsigned int machineCount)
+    : machineCount(machineCount), avx2(false), groups(0), laneInstructions(0) {
+#if defined(CHIP8_HAVE_AVX2)
+  avx2 = cpuHasAVX2();
+#endif
+  laneCount = (machineCount + laneBlock - 1) / laneBlock * laneBlock;
+
+  v.assign(16 * laneCount, 0);
+  stack.assign(16 * laneCount, 0);
+
+  pc.assign(laneCount, 0x200);
+  index.assign(laneCount, 0);
+  sp.assign(laneCount, 0);
+  delayTimer.assign(laneCount, 0);
+  soundTimer.assign(laneCount, 0);
+  keys.assign(laneCount, 0);
+  enabled.assign(laneCount, 0);
+  cycles.assign(laneCount, 0);
+  random.resize(laneCount);
+  for (Chip8Random &laneRandom : random) {
+    laneRandom.seed(0); // Chip8 default
+  }
+
+  vram.assign(32 * laneCount, 0);
+  memory.resize(4096 * laneCount);
+
+  active.assign(laneCount, 0);
+  remaining.assign(laneCount, 0);
+  scratch.assign(laneCount, 0);
+  written.assign(4096, 0);
+
+  // Let Chip8 lay out the font and ROM, then give every machine a copy
+  Chip8 initial(gameBinaryData, gameBinaryDataSize);
+  for (unsigned short address = 0; address < 4096; address++) {
+    memory[address] = initial.peekMemory(address);
+  }
+  for (unsigned int lane = 1; lane < laneCount; lane++) {
+    memcpy(&memory[lane * 4096], &memory[0], 4096);
+  }
+
+  for (unsigned int machine = 0; machine < machineCount; machine++) {
+    enabled[machine] = 1;
+  }
+}
+
+unsigned short Chip8Lockstep::fetch(unsigned int lane, unsigned short address) const {
+  const unsigned char *laneMemory = &memory[lane * 4096];
+  return (laneMemory[address & 0xFFF] << 8) | laneMemory[(address + 1) & 0xFFF];
+}
+
+bool Chip8Lockstep::isHalted(unsigned int machine) const {
+  return fetch(machine, pc[machine]) == (0x1000 | pc[machine]);
+}
+
+void Chip8Lockstep::exportMachine(unsigned int machine, Chip8 &chip8) const {
+  for (int i = 0; i < 16; i++) {
+    chip8.v[i] = v[i * laneCount + machine];
+    chip8.stack[i] = stack[i * laneCount + machine];
+  }
+  chip8.pc = pc[machine];
+  chip8.index = index[machine];
+  chip8.sp = sp[machine];
+  chip8.delayTimer = delayTimer[machine];
+  chip8.soundTimer = soundTimer[machine];
+  chip8.setKeys(keys[machine]);
+  chip8.cycles = cycles[machine];
+  chip8.random = random[machine];
+  chip8.soundEdgeCount = 0; // Not recorded here
+
+  memcpy(chip8.vram, &vram[machine * 32], sizeof(chip8.vram));
+  chip8.dirtyRows = Chip8::allRows;
+
+  // Only drops decoded instructions whose bytes actually change
+  chip8.loadMemory(0, &memory[machine * 4096], 4096);
+}
+
+void Chip8Lockstep::tickTimers() {
+  for (unsigned int lane = 0; lane < laneCount; lane++) {
+    if (enabled[lane] && delayTimer[lane] > 0) {
+      delayTimer[lane]--;
+    }
+    if (enabled[lane] && soundTimer[lane] > 0) {
+      soundTimer[lane]--;
+    }
+  }
+}
+
+unsigned short Chip8Lockstep::lowestPC() const {
+#if defined(CHIP8_HAVE_AVX2)
+  if (avx2) {
+    return lowestPCAVX2(pc.data(), remaining.data(), laneCount);
+  }
+#endif
+  unsigned short lowest = 0xFFFF;
+  for (unsigned int lane = 0; lane < laneCount; lane++) {
+    unsigned short key = remaining[lane] ? pc[lane] : 0xFFFF;
+    lowest = std::min(lowest, key);
+  }
+  return lowest;
+}
+
+unsigned int Chip8Lockstep::selectLanes(unsigned short address) {
+#if defined(CHIP8_HAVE_AVX2)
+  if (avx2) {
+    return selectLanesAVX2(address, pc.data(), remaining.data(), active.data(), laneCount);
+  }
+#endif
+  unsigned int lanes = 0;
+  for (unsigned int lane = 0; lane < laneCount; lane++) {
+    unsigned int runs = (remaining[lane] != 0) & (pc[lane] == address);
+    active[lane] = (unsigned char)(0 - runs);
+    remaining[lane] -= runs;
+    lanes += runs;
+  }
+  return lanes;
+}
+
+void Chip8Lockstep::advancePC(unsigned int first, unsigned int last) {
+  unsigned int lane = first;
+#if defined(CHIP8_HAVE_AVX2)
+  if (avx2) {
+    lane = advancePCAVX2(pc.data(), active.data(), first, last);
+  }
+#endif
+  for (; lane < last; lane++) {
+    pc[lane] += active[lane] & 2;
+  }
+}
+
+void Chip8Lockstep::runCycles(unsigned long long count) {
+  // Budgets are 16-bit so the scans below fit 16 lanes per vector. Machines
+  // do not interact, so where the chunks split does not affect the results.
+  while (count > 0) {
+    unsigned short chunk = (unsigned short)std::min<unsigned long long>(count, 0xFFFF);
+    runChunk(chunk);
+    count -= chunk;
+  }
+}
+
+void Chip8Lockstep::runChunk(unsigned short count) {
+  for (unsigned int lane = 0; lane < laneCount; lane++) {
+    remaining[lane] = enabled[lane] ? count : 0;
+  }
+
+  while (true) {
+    // Lowest pc first: lanes that branched ahead wait for the others to catch
+    // up, which is where loops and subroutine returns reconverge
+    unsigned short address = lowestPC();
+    if (address == 0xFFFF && std::all_of(remaining.begin(), remaining.end(), [](unsigned short r) { return r == 0; })) {
+      break; // A machine can only be at 0xFFFF after wandering through empty memory, but check
+    }
+
+    unsigned int lanes = selectLanes(address);
+
+    unsigned int first = 0;
+    while (!active[first]) {
+      first++;
+    }
+    unsigned int last = laneCount;
+    while (!active[last - 1]) {
+      last--;
+    }
+
+    unsigned short opcode = fetch(first, address);
+
+    // Machines start with identical memory, so the opcode can only differ
+    // where some machine has written. Lanes holding other code wait.
+    if (written[address & 0xFFF] | written[(address + 1) & 0xFFF]) {
+      for (unsigned int lane = first; lane < last; lane++) {
+        if (active[lane] && fetch(lane, address) != opcode) {
+          active[lane] = 0;
+          remaining[lane]++;
+          lanes--;
+        }
+      }
+    }
+
+    groups++;
+    laneInstructions += lanes;
+
+    // Only visit the blocks that contain active lanes
+    first = first / laneBlock * laneBlock;
+    last = (last + laneBlock - 1) / laneBlock * laneBlock;
+    execute(opcode, first, last);
+
+    if (lanes == 1) {
+      runAlone(first, last);
+    }
+  }
+
+  for (unsigned int lane = 0; lane < laneCount; lane++) {
+    cycles[lane] += enabled[lane] ? count : 0;
+  }
+}
+
+void Chip8Lockstep::runAlone(unsigned int first, unsigned int last) {
+  unsigned int lane = first;
+  while (!active[lane]) {
+    lane++;
+  }
+
+  // A lane that runs by itself keeps the lowest pc until it reaches the next
+  // lowest one, the scheduler would pick it every time. Skip the scans and
+  // run it as a plain interpreter until then.
+  unsigned short budget = remaining[lane];
+  remaining[lane] = 0;
+  unsigned short next = lowestPC();
+  remaining[lane] = budget;
+
+  while (remaining[lane] && pc[lane] < next) {
+    remaining[lane]--;
+    groups++;
+    laneInstructions++;
+    execute(fetch(lane, pc[lane]), first, last);
+  }
+}
+
+template <typename LaneOp>
+void Chip8Lockstep::applyBytes(unsigned char *dst, const unsigned char *a, const unsigned char *b, unsigned int first, unsigned int last) {
+  unsigned int lane = first;
+#if defined(CHIP8_HAVE_AVX2)
+  if (avx2) {
+    lane = applyBytesAVX2<LaneOp>(dst, a, b, active.data(), first, last);
+  }
+#endif
+  for (; lane < last; lane++) {
+    dst[lane] = active[lane] ? LaneOp::scalar(a[lane], b[lane]) : dst[lane];
+  }
+}
+
+template <typename LaneOp>
+void Chip8Lockstep::applyImmediate(unsigned char *dst, const unsigned char *a, unsigned char immediate, unsigned int first, unsigned int last) {
+  unsigned int lane = first;
+#if defined(CHIP8_HAVE_AVX2)
+  if (avx2) {
+    lane = applyImmediateAVX2<LaneOp>(dst, a, immediate, active.data(), first, last);
+  }
+#endif
+  for (; lane < last; lane++) {
+    dst[lane] = active[lane] ? LaneOp::scalar(a[lane], immediate) : dst[lane];
+  }
+}
+
+void Chip8Lockstep::skipIf(const unsigned char *condition, unsigned int first, unsigned int last) {
+  for (unsigned int lane = first; lane < last; lane++) {
+    pc[lane] += (active[lane] && condition[lane]) ? 2 : 0;
+  }
+}
+
+void Chip8Lockstep::drawSprite(unsigned int lane, unsigned char x, unsigned char y, unsigned char n) {
+  // Same as Chip8::drawSprite, on this lane's memory and VRAM
+  unsigned char &vf = v[0xF * laneCount + lane];
+  const unsigned char &vx = v[x * laneCount + lane];
+  const unsigned char &vy = v[y * laneCount + lane];
+  const unsigned char *laneMemory = &memory[lane * 4096];
+  unsigned long long *laneVRAM = &vram[lane * 32];
+
+  // Pixel by pixel when VF positions the sprite, like Chip8::drawSpriteVF()
+  if (x == 0xF || y == 0xF) {
+    vf = 0;
+    for (int yLine = 0; yLine < n; yLine++) {
+      unsigned char bits = laneMemory[(index[lane] + yLine) & 0xFFF];
+      for (int xLine = 0; xLine < 8; xLine++) {
+        if (!(bits & (0x80 >> xLine))) {
+          continue;
+        }
+
+        int px = (vx & 63) + xLine;
+        int py = (vy & 31) + yLine;
+        if (px < 64 && py < 32 && (laneVRAM[py] & (1ULL << (63 - px)))) {
+          vf = 1;
+        }
+
+        px = (vx & 63) + xLine;
+        py = (vy & 31) + yLine;
+        if (px < 64 && py < 32) {
+          laneVRAM[py] ^= 1ULL << (63 - px);
+        }
+      }
+    }
+    return;
+  }
+
+  unsigned short startX = vx & 63;
+  unsigned short startY = vy & 31;
+  vf = 0;
+
+  for (int yLine = 0; yLine < n && startY + yLine < 32; yLine++) {
+    unsigned long long row = ((unsigned long long)laneMemory[(index[lane] + yLine) & 0xFFF] << 56) >> startX;
+    if (laneVRAM[startY + yLine] & row) {
+      vf = 1;
+    }
+    laneVRAM[startY + yLine] ^= row;
+  }
+}
+
+void Chip8Lockstep::execute(unsigned short opcode, unsigned int first, unsigned int last) {
+  unsigned char x = (opcode & 0x0F00) >> 8;
+  unsigned char y = (opcode & 0x00F0) >> 4;
+  unsigned char n = opcode & 0x000F;
+  unsigned char nn = opcode & 0x00FF;
+  unsigned short nnn = opcode & 0x0FFF;
+
+  unsigned char *vx = reg(x);
+  unsigned char *vy = reg(y);
+  unsigned char *vf = reg(0xF);
+  unsigned char *s = scratch.data();
+
+  // Anything that is not plain register arithmetic goes lane by lane
+  auto forActive = [&](auto body) {
+    for (unsigned int lane = first; lane < last; lane++) {
+      if (active[lane]) {
+        body(lane);
+      }
+    }
+  };
+
+  advancePC(first, last);
+
+  // Flag-setting ALU ops compute the flag into scratch, commit it to VF, and
+  // only then update Vx from the registers as they are now. Same order as
+  // Chip8, which matters when X or Y is F.
+  switch (opcode & 0xF000) {
+  case 0x0000:
+    switch (nnn) {
+    case 0x0E0: // 00E0 - CLS
+      forActive([&](unsigned int lane) { memset(&vram[lane * 32], 0, 32 * sizeof(unsigned long long)); });
+      break;
+    case 0x0EE: // 00EE - RET
+      forActive([&](unsigned int lane) {
+        pc[lane] = stack[sp[lane] * laneCount + lane];
+        sp[lane] = (sp[lane] - 1) & 0xF;
+      });
+      break;
+    }
+    break;
+
+  case 0x1000: // 1NNN - JP addr
+    forActive([&](unsigned int lane) { pc[lane] = nnn; });
+    break;
+
+  case 0x2000: // 2NNN - CALL addr
+    forActive([&](unsigned int lane) {
+      sp[lane] = (sp[lane] + 1) & 0xF;
+      stack[sp[lane] * laneCount + lane] = pc[lane];
+      pc[lane] = nnn;
+    });
+    break;
+
+  case 0x3000: // 3XNN - SE Vx, byte
+    applyImmediate<LaneEqual>(s, vx, nn, first, last);
+    skipIf(s, first, last);
+    break;
+
+  case 0x4000: // 4XNN - SNE Vx, byte
+    applyImmediate<LaneNotEqual>(s, vx, nn, first, last);
+    skipIf(s, first, last);
+    break;
+
+  case 0x5000: // 5XY0 - SE Vx, Vy
+    applyBytes<LaneEqual>(s, vx, vy, first, last);
+    skipIf(s, first, last);
+    break;
+
+  case 0x6000: // 6XNN - LD Vx, byte
+    applyImmediate<LaneMove>(vx, vx, nn, first, last);
+    break;
+
+  case 0x7000: // 7XNN - ADD Vx, byte
+    applyImmediate<LaneAdd>(vx, vx, nn, first, last);
+    break;
+
+  case 0x8000:
+    switch (n) {
+    case 0: // 0x8XY0 - LD Vx, Vy
+      applyBytes<LaneMove>(vx, vx, vy, first, last);
+      break;
+    case 1: // 0x8XY1 - OR Vx, Vy
+      applyBytes<LaneOr>(vx, vx, vy, first, last);
+      break;
+    case 2: // 0x8XY2 - AND Vx, Vy
+      applyBytes<LaneAnd>(vx, vx, vy, first, last);
+      break;
+    case 3: // 0x8XY3 - XOR Vx, Vy
+      applyBytes<LaneXor>(vx, vx, vy, first, last);
+      break;
+    case 4: // 0x8XY4 - ADD Vx, Vy
+      applyBytes<LaneCarry>(s, vx, vy, first, last);
+      applyBytes<LaneMove>(vf, vf, s, first, last);
+      applyBytes<LaneAdd>(vx, vx, vy, first, last);
+      break;
+    case 5: // 0x8XY5 - SUB Vx, Vy
+      applyBytes<LaneGreater>(s, vx, vy, first, last);
+      applyBytes<LaneMove>(vf, vf, s, first, last);
+      applyBytes<LaneSub>(vx, vx, vy, first, last);
+      break;
+    case 6: // 0x8XY6 - SHR Vx {, Vy}
+      applyBytes<LaneLowBit>(s, vx, vx, first, last);
+      applyBytes<LaneMove>(vf, vf, s, first, last);
+      applyBytes<LaneShiftRight>(vx, vx, vx, first, last);
+      break;
+    case 7: // 0x8XY7 - SUBN Vx, Vy
+      applyBytes<LaneGreater>(s, vy, vx, first, last);
+      applyBytes<LaneMove>(vf, vf, s, first, last);
+      applyBytes<LaneSubReverse>(vx, vx, vy, first, last);
+      break;
+    case 0xE: // 0x8XYE - SHL Vx {, Vy}
+      applyBytes<LaneHighBit>(s, vx, vx, first, last);
+      applyBytes<LaneMove>(vf, vf, s, first, last);
+      applyBytes<LaneShiftLeft>(vx, vx, vx, first, last);
+      break;
+    }
+    break;
+
+  case 0x9000: // 9XY0 - SNE Vx, Vy
+    applyBytes<LaneNotEqual>(s, vx, vy, first, last);
+    skipIf(s, first, last);
+    break;
+
+  case 0xA000: // ANNN - LD I, addr
+    for (unsigned int lane = first; lane < last; lane++) {
+      index[lane] = active[lane] ? nnn : index[lane];
+    }
+    break;
+
+  case 0xB000: // BNNN - JP V0, addr
+    forActive([&](unsigned int lane) { pc[lane] = v[lane] + nnn; });
+    break;
+
+  case 0xC000: // CXNN - RND Vx, byte
+    forActive([&](unsigned int lane) { vx[lane] = random[lane].next() & nn; });
+    break;
+
+  case 0xD000: // DXYN - DRW Vx, Vy, nibble
+    forActive([&](unsigned int lane) { drawSprite(lane, x, y, n); });
+    break;
+
+  case 0xE000:
+    switch (nn) {
+    case 0x9E: // EX9E - SKP Vx
+      forActive([&](unsigned int lane) { pc[lane] += ((keys[lane] >> (vx[lane] & 0xF)) & 1) ? 2 : 0; });
+      break;
+    case 0xA1: // EXA1 - SKNP Vx
+      forActive([&](unsigned int lane) { pc[lane] += ((keys[lane] >> (vx[lane] & 0xF)) & 1) ? 0 : 2; });
+      break;
+    }
+    break;
+
+  case 0xF000:
+    switch (nn) {
+    case 0x07: // FX07 - LD Vx, DT
+      applyBytes<LaneMove>(vx, vx, delayTimer.data(), first, last);
+      break;
+    case 0x15: // FX15 - LD DT, Vx
+      applyBytes<LaneMove>(delayTimer.data(), delayTimer.data(), vx, first, last);
+      break;
+    case 0x18: // FX18 - LD ST, Vx
+      applyBytes<LaneMove>(soundTimer.data(), soundTimer.data(), vx, first, last);
+      break;
+    case 0x1E: // FX1E - ADD I, Vx
+      forActive([&](unsigned int lane) {
+        index[lane] += vx[lane];
+        vf[lane] = (index[lane] > 0xFFF) ? 1 : 0;
+      });
+      break;
+    case 0x0A: // FX0A - Get key
+      forActive([&](unsigned int lane) {
+        // Key F is never reported, as in Chip8
+        unsigned short pressed = keys[lane] & 0x7FFF;
+        if (pressed) {
+          int key = 0;
+          while (!((pressed >> key) & 1)) {
+            key++;
+          }
+          vx[lane] = key;
+        }
+        else {
+          pc[lane] -= 2;
+        }
+      });
+      break;
+    case 0x29: // FX29 - LD F, Vx
+      forActive([&](unsigned int lane) { index[lane] = 0x50 + (vx[lane] * 5); });
+      break;
+    case 0x33: // FX33 - LD B, Vx
+      forActive([&](unsigned int lane) {
+        unsigned char *laneMemory = &memory[lane * 4096];
+        laneMemory[index[lane] & 0xFFF] = vx[lane] / 100;
+        laneMemory[(index[lane] + 1) & 0xFFF] = (vx[lane] / 10) % 10;
+        laneMemory[(index[lane] + 2) & 0xFFF] = vx[lane] % 10;
+        for (int i = 0; i < 3; i++) {
+          written[(index[lane] + i) & 0xFFF] = 1;
+        }
+      });
+      break;
+    case 0x55: // FX55 - LD [I], Vx
+      forActive([&](unsigned int lane) {
+        for (int i = 0; i <= x; i++) {
+          memory[lane * 4096 + ((index[lane] + i) & 0xFFF)] = v[i * laneCount + lane];
+          written[(index[lane] + i) & 0xFFF] = 1;
+        }
+      });
+      break;
+    case 0x65: // FX65 - LD Vx, [I]
+      forActive([&](unsigned int lane) {
+        for (int i = 0; i <= x; i++) {
+          v[i * laneCount + lane] = memory[lane * 4096 + ((index[lane] + i) & 0xFFF)];
+        }
+      });
+      break;
+    }
+    break;
+  }
+}
@@ -0,0 +1,194 @@
+#include <cstring>
+#include <algorithm>
+#include <map>
+
+#include "chip8_profiler.h"
+
+namespace {
+  const char *const kindNames[36] = {
+    "unknown", "CLS", "RET", "SYS addr", "JP addr", "CALL addr", "SE Vx, byte", "SNE Vx, byte", "SE Vx, Vy",
+    "LD Vx, byte", "ADD Vx, byte", "LD Vx, Vy", "OR Vx, Vy", "AND Vx, Vy", "XOR Vx, Vy", "ADD Vx, Vy",
+    "SUB Vx, Vy", "SHR Vx", "SUBN Vx, Vy", "SHL Vx", "SNE Vx, Vy", "LD I, addr", "JP V0, addr", "RND Vx, byte",
+    "DRW Vx, Vy, n", "SKP Vx", "SKNP Vx", "LD Vx, DT", "LD Vx, K", "LD DT, Vx", "LD ST, Vx",
+    "ADD I, Vx", "LD F, Vx", "LD B, Vx", "LD [I], Vx", "LD Vx, [I]"
+  };
+}
+
+Chip8Profiler::Chip8Profiler() {
+  reset();
+}
+
+void Chip8Profiler::reset() {
+  memset(addressCounts, 0, sizeof(addressCounts));
+  memset(addressOpcodes, 0, sizeof(addressOpcodes));
+  memset(kindCounts, 0, sizeof(kindCounts));
+  total = 0;
+
+  nodes.clear();
+  nodes.push_back({ -1, 0x200, 0, {} });
+  current = 0;
+  depth = 0;
+  maxObservedDepth = 0;
+}
+
+int Chip8Profiler::kindOf(unsigned short opcode) {
+  unsigned char n = opcode & 0x000F;
+  unsigned char nn = opcode & 0x00FF;
+
+  switch (opcode & 0xF000) {
+  case 0x0000: return opcode == 0x00E0 ? 1 : opcode == 0x00EE ? 2 : 3;
+  case 0x1000: return 4;
+  case 0x2000: return 5;
+  case 0x3000: return 6;
+  case 0x4000: return 7;
+  case 0x5000: return 8;
+  case 0x6000: return 9;
+  case 0x7000: return 10;
+  case 0x8000:
+    switch (n) {
+    case 0x0: return 11;
+    case 0x1: return 12;
+    case 0x2: return 13;
+    case 0x3: return 14;
+    case 0x4: return 15;
+    case 0x5: return 16;
+    case 0x6: return 17;
+    case 0x7: return 18;
+    case 0xE: return 19;
+    }
+    return 0;
+  case 0x9000: return 20;
+  case 0xA000: return 21;
+  case 0xB000: return 22;
+  case 0xC000: return 23;
+  case 0xD000: return 24;
+  case 0xE000: return nn == 0x9E ? 25 : nn == 0xA1 ? 26 : 0;
+  case 0xF000:
+    switch (nn) {
+    case 0x07: return 27;
+    case 0x0A: return 28;
+    case 0x15: return 29;
+    case 0x18: return 30;
+    case 0x1E: return 31;
+    case 0x29: return 32;
+    case 0x33: return 33;
+    case 0x55: return 34;
+    case 0x65: return 35;
+    }
+    return 0;
+  }
+  return 0;
+}
+
+const char *Chip8Profiler::kindName(int kind) {
+  return kindNames[kind];
+}
+
+int Chip8Profiler::child(int parent, unsigned short address) {
+  for (int index : nodes[parent].children) {
+    if (nodes[index].address == address) {
+      return index;
+    }
+  }
+
+  nodes.push_back({ parent, address, 0, {} });
+  int index = (int)nodes.size() - 1;
+  nodes[parent].children.push_back(index);
+  return index;
+}
+
+unsigned long long Chip8Profiler::inclusiveCount(int node) const {
+  unsigned long long count = nodes[node].count;
+  for (int index : nodes[node].children) {
+    count += inclusiveCount(index);
+  }
+  return count;
+}
+
+void Chip8Profiler::writeReport(FILE *out, int topAddresses) const {
+  double percent = total ? 100.0 / total : 0.0;
+
+  fprintf(out, "instructions: %llu\n", total);
+  fprintf(out, "max call depth: %d\n", maxObservedDepth);
+
+  // Hottest addresses
+  std::vector<unsigned short> addresses;
+  for (unsigned short address = 0; address < 4096; address++) {
+    if (addressCounts[address]) {
+      addresses.push_back(address);
+    }
+  }
+  std::sort(addresses.begin(), addresses.end(), [&](unsigned short a, unsigned short b) {
+    return addressCounts[a] != addressCounts[b] ? addressCounts[a] > addressCounts[b] : a < b;
+  });
+  if ((int)addresses.size() > topAddresses) {
+    addresses.resize(topAddresses);
+  }
+
+  fprintf(out, "\nhot addresses:\n");
+  fprintf(out, "  %-7s %14s %8s  %-6s %s\n", "address", "count", "%", "opcode", "kind");
+  for (unsigned short address : addresses) {
+    unsigned short opcode = addressOpcodes[address];
+    fprintf(out, "  0x%03X   %14llu %7.2f%%  %04X   %s\n", address, addressCounts[address], addressCounts[address] * percent, opcode, kindName(kindOf(opcode)));
+  }
+
+  // Instruction mix
+  std::vector<int> kinds;
+  for (int kind = 0; kind < 36; kind++) {
+    if (kindCounts[kind]) {
+      kinds.push_back(kind);
+    }
+  }
+  std::sort(kinds.begin(), kinds.end(), [&](int a, int b) { return kindCounts[a] > kindCounts[b]; });
+
+  fprintf(out, "\ninstruction kinds:\n");
+  for (int kind : kinds) {
+    fprintf(out, "  %-14s %14llu %7.2f%%\n", kindName(kind), kindCounts[kind], kindCounts[kind] * percent);
+  }
+
+  // Subroutines, keyed by entry address. Self counts only the instructions
+  // executed directly in it, inclusive also counts everything it called.
+  std::map<unsigned short, unsigned long long> self;
+  std::map<unsigned short, unsigned long long> inclusive;
+  for (int node = 1; node < (int)nodes.size(); node++) {
+    self[nodes[node].address] += nodes[node].count;
+
+    // Only the outermost frame of a recursion adds its subtree
+    bool nested = false;
+    for (int ancestor = nodes[node].parent; ancestor > 0; ancestor = nodes[ancestor].parent) {
+      nested |= nodes[ancestor].address == nodes[node].address;
+    }
+    if (!nested) {
+      inclusive[nodes[node].address] += inclusiveCount(node);
+    }
+  }
+
+  std::vector<unsigned short> subroutines;
+  for (const auto &entry : inclusive) {
+    subroutines.push_back(entry.first);
+  }
+  std::sort(subroutines.begin(), subroutines.end(), [&](unsigned short a, unsigned short b) { return inclusive[a] > inclusive[b]; });
+
+  fprintf(out, "\nsubroutines:\n");
+  fprintf(out, "  %-7s %14s %8s %14s %8s\n", "entry", "self", "%", "inclusive", "%");
+  for (unsigned short address : subroutines) {
+    fprintf(out, "  0x%03X   %14llu %7.2f%% %14llu %7.2f%%\n", address, self[address], self[address] * percent, inclusive[address], inclusive[address] * percent);
+  }
+}
+
+void Chip8Profiler::writeStack(FILE *out, int node) const {
+  if (nodes[node].parent >= 0) {
+    writeStack(out, nodes[node].parent);
+    fputc(';', out);
+  }
+  fprintf(out, "0x%03X", nodes[node].address);
+}
+
+void Chip8Profiler::writeFoldedStacks(FILE *out) const {
+  for (int node = 0; node < (int)nodes.size(); node++) {
+    if (nodes[node].count) {
+      writeStack(out, node);
+      fprintf(out, " %llu\n", nodes[node].count);
+    }
+  }
+}
@@ -0,0 +1,104 @@
+#include "chip8_rewind.h"
+
+Chip8Rewind::Chip8Rewind(Chip8 &chip8, unsigned long long cyclesPerFrame, unsigned int keyframeInterval, unsigned int keyframesPerGroup, unsigned int groupCount)
+    : chip8(chip8), cyclesPerFrame(cyclesPerFrame), keyframeInterval(keyframeInterval ? keyframeInterval : 1),
+      keyframesPerGroup(keyframesPerGroup ? keyframesPerGroup : 1), groupHead(0), groupCount(0), frame(0) {
+  groups.resize(groupCount ? groupCount : 1);
+  for (Group &group : groups) {
+    group.deltas.resize(this->keyframesPerGroup - 1);
+    group.deltaCount = 0;
+  }
+  keyLog.assign(groups.size() * framesPerGroup(), 0);
+}
+
+unsigned long long Chip8Rewind::getOldestFrame() const {
+  return groupCount ? groups[groupHead].firstFrame : frame;
+}
+
+unsigned long long Chip8Rewind::getMemoryUsage() const {
+  unsigned long long bytes = keyLog.size() * sizeof(unsigned short);
+  for (const Group &group : groups) {
+    bytes += group.base.capacity();
+    for (const std::vector<unsigned char> &delta : group.deltas) {
+      bytes += delta.capacity();
+    }
+  }
+  return bytes;
+}
+
+void Chip8Rewind::recordKeyframe() {
+  // A group starts wherever the previous one is full, or after a rewind emptied the ring
+  if (groupCount > 0) {
+    Group &newest = groupAt(groupCount - 1);
+    if (newest.deltaCount + 1 < keyframesPerGroup) {
+      newest.deltas[newest.deltaCount++] = chip8.snapshotDelta(newest.base);
+      return;
+    }
+  }
+
+  if (groupCount == groups.size()) {
+    groupHead = (groupHead + 1) % groups.size(); // Drop the oldest group
+    groupCount--;
+  }
+
+  Group &group = groupAt(groupCount++);
+  group.firstFrame = frame;
+  group.base = chip8.snapshot();
+  group.deltaCount = 0;
+}
+
+void Chip8Rewind::runFrame(unsigned short keyMask) {
+  // Skip the keyframe if rewind() left us standing on one
+  if (frame % keyframeInterval == 0) {
+    bool recorded = false;
+    if (groupCount > 0) {
+      const Group &newest = groupAt(groupCount - 1);
+      recorded = newest.firstFrame + (unsigned long long)newest.deltaCount * keyframeInterval == frame;
+    }
+    if (!recorded) {
+      recordKeyframe();
+    }
+  }
+
+  keyLog[frame % keyLog.size()] = keyMask;
+
+  chip8.setKeys(keyMask);
+  chip8.runCycles(cyclesPerFrame);
+  chip8.tickTimers();
+  frame++;
+}
+
+bool Chip8Rewind::rewind(unsigned long long frames) {
+  if (frames > frame || frame - frames < getOldestFrame() || groupCount == 0) {
+    return false;
+  }
+  unsigned long long target = frame - frames;
+
+  // Newest keyframe at or before the target
+  unsigned int groupIndex = (unsigned int)((target - getOldestFrame()) / framesPerGroup());
+  Group &group = groupAt(groupIndex);
+  unsigned int keyframe = (unsigned int)((target - group.firstFrame) / keyframeInterval);
+  if (keyframe > group.deltaCount) {
+    keyframe = group.deltaCount; // Target lies after the last keyframe taken
+  }
+
+  if (keyframe == 0) {
+    chip8.restore(group.base);
+  }
+  else {
+    chip8.restoreDelta(group.base, group.deltas[keyframe - 1]);
+  }
+
+  // Forget the future, it is about to be rewritten
+  groupCount = groupIndex + 1;
+  group.deltaCount = keyframe;
+
+  // Re-simulate up to the target from the logged input
+  for (frame = group.firstFrame + (unsigned long long)keyframe * keyframeInterval; frame < target; frame++) {
+    chip8.setKeys(keyLog[frame % keyLog.size()]);
+    chip8.runCycles(cyclesPerFrame);
+    chip8.tickTimers();
+  }
+
+  return true;
+}
@@ -0,0 +1,231 @@
+#include <cstring>
+#include <bit>
+
+#include "chip8.h"
+
+// Snapshot layout, all values little-endian:
+//
+//   0  'C' '8' 'S' 'S'
+//   4  u8  version
+//   5  u8  kind, 0 for a full snapshot and 1 for a delta
+//
+// Full snapshot:
+//   6  core block (below)
+//  80  vram, 32 x u64
+// 336  memory, 4096 bytes
+//
+// Delta:
+//   6  u64 FNV-1a hash of the base snapshot it applies to
+//  14  core block
+//  88  u64 mask of the 64-byte memory pages that differ from base
+//  96  u32 mask of the VRAM rows that differ from base
+// 100  the differing pages, then the differing rows, both in ascending order
+//
+// Core block, 74 bytes:
+//   u16 pc, u16 index, u8 sp, u8 delay timer, u8 sound timer, u8 vram dirty,
+//   u16 keys (bit i is key i), u8 v[16], u16 stack[16], u64 cycles,
+//   u64 CXNN random state
+
+namespace {
+  const unsigned char snapshotMagic[4] = { 'C', '8', 'S', 'S' };
+  const unsigned char snapshotVersion = 2;
+  const unsigned char snapshotKindFull = 0;
+  const unsigned char snapshotKindDelta = 1;
+
+  const unsigned int headerSize = 6;
+  const unsigned int coreSize = 74;
+  const unsigned int pageSize = 64;
+  const unsigned int pageCount = 4096 / pageSize;
+
+  const unsigned int fullVRAMOffset = headerSize + coreSize;
+  const unsigned int fullMemoryOffset = fullVRAMOffset + 32 * 8;
+  const unsigned int fullSize = fullMemoryOffset + 4096;
+
+  const unsigned int deltaCoreOffset = headerSize + 8;
+  const unsigned int deltaMasksOffset = deltaCoreOffset + coreSize;
+  const unsigned int deltaDataOffset = deltaMasksOffset + 8 + 4;
+
+  void put(std::vector<unsigned char> &out, unsigned long long value, int bytes) {
+    for (int i = 0; i < bytes; i++) {
+      out.push_back((unsigned char)(value >> (i * 8)));
+    }
+  }
+
+  unsigned long long get(const unsigned char *in, int bytes) {
+    unsigned long long value = 0;
+    for (int i = 0; i < bytes; i++) {
+      value |= (unsigned long long)in[i] << (i * 8);
+    }
+    return value;
+  }
+
+  unsigned long long hashBlob(const std::vector<unsigned char> &blob) {
+    unsigned long long hash = 14695981039346656037ULL;
+    for (unsigned char byte : blob) {
+      hash ^= byte;
+      hash *= 1099511628211ULL;
+    }
+    return hash;
+  }
+
+  bool hasHeader(const std::vector<unsigned char> &blob, unsigned char kind) {
+    return blob.size() >= headerSize && memcmp(blob.data(), snapshotMagic, 4) == 0 && blob[4] == snapshotVersion && blob[5] == kind;
+  }
+
+  bool isFull(const std::vector<unsigned char> &blob) {
+    return hasHeader(blob, snapshotKindFull) && blob.size() == fullSize;
+  }
+}
+
+std::vector<unsigned char> Chip8::snapshot() const {
+  std::vector<unsigned char> out;
+  out.reserve(fullSize);
+
+  out.insert(out.end(), snapshotMagic, snapshotMagic + 4);
+  out.push_back(snapshotVersion);
+  out.push_back(snapshotKindFull);
+
+  // Core block
+  put(out, pc, 2);
+  put(out, index, 2);
+  put(out, sp, 1);
+  put(out, delayTimer, 1);
+  put(out, soundTimer, 1);
+  put(out, dirtyRows != 0, 1);
+  unsigned short keyMask = 0;
+  for (int i = 0; i < 16; i++) {
+    keyMask |= keys[i] ? (1 << i) : 0;
+  }
+  put(out, keyMask, 2);
+  out.insert(out.end(), v, v + 16);
+  for (int i = 0; i < 16; i++) {
+    put(out, stack[i], 2);
+  }
+  put(out, cycles, 8);
+  put(out, random.state, 8);
+
+  for (int y = 0; y < 32; y++) {
+    put(out, vram[y], 8);
+  }
+  out.insert(out.end(), memory, memory + 4096);
+
+  return out;
+}
+
+std::vector<unsigned char> Chip8::snapshotDelta(const std::vector<unsigned char> &base) const {
+  // Easiest to diff against a full snapshot of the current state
+  std::vector<unsigned char> current = snapshot();
+  if (!isFull(base)) {
+    return current;
+  }
+
+  std::vector<unsigned char> out;
+  out.insert(out.end(), snapshotMagic, snapshotMagic + 4);
+  out.push_back(snapshotVersion);
+  out.push_back(snapshotKindDelta);
+  put(out, hashBlob(base), 8);
+  out.insert(out.end(), current.begin() + headerSize, current.begin() + headerSize + coreSize);
+
+  unsigned long long pageMask = 0;
+  for (unsigned int page = 0; page < pageCount; page++) {
+    unsigned int offset = fullMemoryOffset + page * pageSize;
+    if (memcmp(&current[offset], &base[offset], pageSize) != 0) {
+      pageMask |= 1ULL << page;
+    }
+  }
+
+  unsigned int rowMask = 0;
+  for (unsigned int row = 0; row < 32; row++) {
+    unsigned int offset = fullVRAMOffset + row * 8;
+    if (memcmp(&current[offset], &base[offset], 8) != 0) {
+      rowMask |= 1U << row;
+    }
+  }
+
+  put(out, pageMask, 8);
+  put(out, rowMask, 4);
+
+  for (unsigned int page = 0; page < pageCount; page++) {
+    if (pageMask & (1ULL << page)) {
+      unsigned int offset = fullMemoryOffset + page * pageSize;
+      out.insert(out.end(), current.begin() + offset, current.begin() + offset + pageSize);
+    }
+  }
+  for (unsigned int row = 0; row < 32; row++) {
+    if (rowMask & (1U << row)) {
+      unsigned int offset = fullVRAMOffset + row * 8;
+      out.insert(out.end(), current.begin() + offset, current.begin() + offset + 8);
+    }
+  }
+
+  return out;
+}
+
+bool Chip8::restore(const std::vector<unsigned char> &state) {
+  if (!isFull(state)) {
+    return false;
+  }
+
+  const unsigned char *in = state.data() + headerSize;
+  pc = (unsigned short)get(in, 2);
+  index = (unsigned short)get(in + 2, 2);
+  sp = (unsigned short)get(in + 4, 1) & 0xF;
+  delayTimer = in[5];
+  soundTimer = in[6];
+  dirtyRows = allRows; // Whatever was on screen before no longer matches
+  unsigned short keyMask = (unsigned short)get(in + 8, 2);
+  setKeys(keyMask);
+  memcpy(v, in + 10, 16);
+  for (int i = 0; i < 16; i++) {
+    stack[i] = (unsigned short)get(in + 26 + i * 2, 2);
+  }
+  cycles = get(in + 58, 8);
+  random.state = get(in + 66, 8);
+  soundEdgeCount = 0; // They belong to the timeline being left
+
+  for (int y = 0; y < 32; y++) {
+    vram[y] = get(&state[fullVRAMOffset + y * 8], 8);
+  }
+
+  // Only drops decoded instructions whose bytes actually change
+  loadMemory(0, &state[fullMemoryOffset], 4096);
+
+  return true;
+}
+
+bool Chip8::restoreDelta(const std::vector<unsigned char> &base, const std::vector<unsigned char> &delta) {
+  if (!isFull(base) || !hasHeader(delta, snapshotKindDelta) || delta.size() < deltaDataOffset) {
+    return false;
+  }
+  if (get(&delta[headerSize], 8) != hashBlob(base)) {
+    return false; // Taken against a different base
+  }
+
+  unsigned long long pageMask = get(&delta[deltaMasksOffset], 8);
+  unsigned int rowMask = (unsigned int)get(&delta[deltaMasksOffset + 8], 4);
+  unsigned int pages = std::popcount(pageMask);
+  unsigned int rows = std::popcount(rowMask);
+  if (delta.size() != deltaDataOffset + pages * pageSize + rows * 8) {
+    return false;
+  }
+
+  // Rebuild the full snapshot and restore that
+  std::vector<unsigned char> state = base;
+  memcpy(&state[headerSize], &delta[deltaCoreOffset], coreSize);
+
+  const unsigned char *in = &delta[deltaDataOffset];
+  for (unsigned int page = 0; page < pageCount; page++) {
+    if (pageMask & (1ULL << page)) {
+      memcpy(&state[fullMemoryOffset + page * pageSize], in, pageSize);
+      in += pageSize;
+    }
+  }
+  for (unsigned int row = 0; row < 32; row++) {
+    if (rowMask & (1U << row)) {
+      memcpy(&state[fullVRAMOffset + row * 8], in, 8);
+      in += 8;
+    }
+  }
+
+  return restore(state);
+}
@@ -0,0 +1,295 @@
+#include <glad/gl.h>
+#define GLFW_INCLUDE_NONE
+#include <GLFW/glfw3.h>
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <format>
+#include <thread>
+
+#include "chip8_extended.h"
+#include "frontend.h"
+
+static void glfwErrorCallback(int error, const char *description)
+{
+  fprintf(stderr, "Error: %s\n", description);
+}
+
+template <typename Machine>
+unsigned short Frontend<Machine>::readKeys() {
+  // Handle key presses
+  static const int keyMap[16] = {
+    GLFW_KEY_1, GLFW_KEY_2, GLFW_KEY_3, GLFW_KEY_4,
+    GLFW_KEY_Q, GLFW_KEY_W, GLFW_KEY_E, GLFW_KEY_R,
+    GLFW_KEY_A, GLFW_KEY_S, GLFW_KEY_D, GLFW_KEY_F,
+    GLFW_KEY_Z, GLFW_KEY_X, GLFW_KEY_C, GLFW_KEY_V
+  };
+
+  unsigned short keyMask = 0;
+  for (int i = 0; i < 16; i++) {
+    keyMask |= (glfwGetKey(window, keyMap[i]) == GLFW_PRESS) ? (1 << i) : 0;
+  }
+  return keyMask;
+}
+
+template <typename Machine>
+void Frontend<Machine>::pushSound() {
+  if constexpr (classic) {
+    const Chip8::SoundEdge *edges = chip8.getSoundEdges();
+    for (unsigned int i = 0; i < chip8.getSoundEdgeCount(); i++) {
+      beeper.setTone(edges[i].cycle, edges[i].on);
+    }
+    chip8.clearSoundEdges();
+  }
+  else {
+    beeper.setTone(chip8.getCycles(), chip8.getSoundTimer() > 0);
+  }
+}
+
+template <typename Machine>
+void Frontend<Machine>::clearSound() {
+  if constexpr (classic) {
+    chip8.clearSoundEdges();
+  }
+}
+
+template <typename Machine>
+void Frontend<Machine>::publishFrame() {
+  Frame &frame = frames.back();
+  if (chip8.isVRAMDirty()) {
+    vramGeneration++;
+    unsigned long long dirtyRows = ~0ULL;
+    if constexpr (classic) {
+      dirtyRows = chip8.getDirtyRows();
+    }
+    for (int y = 0; y < displayRows; y++) {
+      if ((dirtyRows >> y) & 1) {
+        rowGenerations[y] = vramGeneration;
+      }
+    }
+    chip8.clearVRAMDirty();
+  }
+  if constexpr (classic) {
+    memcpy(frame.vram, chip8.getVRAM(), 32 * sizeof(unsigned long long));
+  }
+  else {
+    memcpy(frame.vram, chip8.getPlane(0), Machine::planeCount * 128 * sizeof(unsigned long long));
+  }
+  memcpy(frame.rowGenerations, rowGenerations, sizeof(frame.rowGenerations));
+  frame.generation = vramGeneration;
+  frame.delayTimer = chip8.getDelayTimer();
+  frame.soundTimer = chip8.getSoundTimer();
+  frame.turbo = turbo.load(std::memory_order_relaxed);
+  frames.publish();
+}
+
+template <typename Machine>
+void Frontend<Machine>::emulate() {
+  using Clock = std::chrono::steady_clock;
+  const Clock::duration tickLength = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / 60.0));
+  Clock::time_point nextTick = Clock::now();
+  bool wasTurbo = false;
+  unsigned long long turboFrames = 0;
+
+  while (running) {
+    bool isTurbo = turbo.load(std::memory_order_relaxed);
+    if (isTurbo != wasTurbo) {
+      // Frames race ahead of the audio clock in turbo, so the tone is muted
+      // rather than garbled, and picks up again in step with the machine
+      beeper.setTone(chip8.getCycles(), !isTurbo && chip8.getSoundTimer() > 0);
+      nextTick = Clock::now();
+      turboFrames = 0;
+      wasTurbo = isTurbo;
+    }
+
+    // One 60 Hz tick: a batch of CPU cycles, then exactly one timer decrement.
+    // Rewinding steps one frame back per tick, as far as the history goes.
+    if (rewinding.load(std::memory_order_relaxed)) {
+      if (rewind.rewind(1)) {
+        if (recording) {
+          recording->truncate(chip8.getCycles());
+        }
+        // The restored state has no edges, just resume at its tone
+        beeper.setTone(chip8.getCycles(), !isTurbo && chip8.getSoundTimer() > 0);
+      }
+    }
+    else {
+      unsigned short keyMask = keys.load(std::memory_order_relaxed);
+      if (recording) {
+        recording->record(chip8.getCycles(), keyMask);
+      }
+      rewind.runFrame(keyMask);
+      if (isTurbo) {
+        clearSound();
+      }
+      else {
+        pushSound();
+      }
+    }
+
+    // Turbo runs ticks back to back, emulated time still advances one frame
+    // per tick, and hands the renderer only every turboPresentInterval'th
+    if (isTurbo) {
+      if (++turboFrames % turboPresentInterval == 0) {
+        publishFrame();
+      }
+      continue;
+    }
+
+    publishFrame();
+
+    // Sleep off the rest of the tick. If we fell more than a tick behind
+    // (debugger break, machine suspended) resync instead of running a burst.
+    nextTick += tickLength;
+    Clock::time_point now = Clock::now();
+    if (now < nextTick) {
+      std::this_thread::sleep_until(nextTick);
+    } else if (now - nextTick > tickLength) {
+      nextTick = now;
+    }
+  }
+}
+
+template <typename Machine>
+void Frontend<Machine>::uploadFrame(const Frame &frame, unsigned long long rows) {
+  if constexpr (classic) {
+    renderer.upload(frame.vram, (unsigned int)rows);
+  }
+  else if (rows) {
+    renderer.uploadPlanes(frame.vram, Machine::planeCount);
+  }
+}
+
+template <typename Machine>
+int Frontend<Machine>::run() {
+  // Display calculated dimensions and stuff
+  int displayWidth = 64 * scale;
+  int displayHeight = 32 * scale;
+
+  glfwSetErrorCallback(glfwErrorCallback);
+
+  if (!glfwInit())
+    return -1;
+
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+  glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+
+  window = glfwCreateWindow(displayWidth, displayHeight, "Chip-8 by @dcronqvist", NULL, NULL);
+  if (!window) {
+    glfwTerminate();
+    return -1;
+  }
+
+  // Center window
+  GLFWmonitor *monitor = glfwGetPrimaryMonitor();
+  const GLFWvidmode *mode = glfwGetVideoMode(monitor);
+  int monitorX, monitorY;
+  glfwGetMonitorPos(monitor, &monitorX, &monitorY);
+  int windowWidth, windowHeight;
+  glfwGetWindowSize(window, &windowWidth, &windowHeight);
+  glfwSetWindowPos(window, monitorX + (mode->width - windowWidth) / 2, monitorY + (mode->height - windowHeight) / 2);
+
+  // Initialize OpenGL
+  glfwMakeContextCurrent(window);
+  gladLoadGL(glfwGetProcAddress);
+  // Emulation keeps its own clock on another thread, so waiting on vsync here is harmless
+  glfwSwapInterval(1);
+
+  glViewport(0, 0, displayWidth, displayHeight);
+
+  renderer.setup(classic ? 64 : 128, displayRows);
+  renderer.setPersistence(phosphor);
+
+  if (!audio.open(sampleRate)) {
+    fprintf(stderr, "No audio device, running without sound\n");
+  }
+
+  // Show the first frame straight away, even before anything is drawn
+  publishFrame();
+  frames.acquire();
+  unsigned long long uploadedGeneration = frames.front().generation;
+  uploadFrame(frames.front(), ~0ULL);
+  renderer.draw();
+  glfwSwapBuffers(window);
+
+  running = true;
+  std::thread emulation(&Frontend::emulate, this);
+
+  int lastDelayTimer = -1;
+  int lastSoundTimer = -1;
+  bool lastTurbo = false;
+  bool tabHeld = false;
+
+  while (!glfwWindowShouldClose(window)) {
+    glfwPollEvents();
+    keys.store(readKeys(), std::memory_order_relaxed);
+    rewinding.store(glfwGetKey(window, GLFW_KEY_BACKSPACE) == GLFW_PRESS, std::memory_order_relaxed);
+
+    // Tab toggles turbo on press
+    bool tabPressed = glfwGetKey(window, GLFW_KEY_TAB) == GLFW_PRESS;
+    if (tabPressed && !tabHeld) {
+      turbo.store(!turbo.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+    tabHeld = tabPressed;
+
+    // Nothing new yet, the emulation thread publishes at 60 Hz
+    if (!frames.acquire()) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      continue;
+    }
+
+    const Frame &frame = frames.front();
+    bool changed = frame.generation != uploadedGeneration;
+    if (changed) {
+      // Rows changed in frames that were skipped count too, so compare
+      // against what was uploaded rather than the last frame
+      unsigned long long rows = 0;
+      for (int y = 0; y < displayRows; y++) {
+        if (frame.rowGenerations[y] > uploadedGeneration) {
+          rows |= 1ULL << y;
+        }
+      }
+      uploadedGeneration = frame.generation;
+      uploadFrame(frame, rows);
+    }
+
+    // With phosphor decay on, pixels that went dark keep fading on frames
+    // that changed nothing
+    if (changed || renderer.isFading()) {
+      renderer.draw();
+      glfwSwapBuffers(window);
+    }
+
+    // Only rebuild the title when there is something new to show
+    if (frame.delayTimer != lastDelayTimer || frame.soundTimer != lastSoundTimer || frame.turbo != lastTurbo) {
+      lastDelayTimer = frame.delayTimer;
+      lastSoundTimer = frame.soundTimer;
+      lastTurbo = frame.turbo;
+      glfwSetWindowTitle(window, std::format("Chip-8 by @dcronqvist - {:} DT, {:} ST{:}", lastDelayTimer, lastSoundTimer, lastTurbo ? " - TURBO" : "").c_str());
+    }
+  }
+
+  running = false;
+  emulation.join();
+
+  audio.close();
+  renderer.teardown();
+  glfwDestroyWindow(window);
+  glfwTerminate();
+  return 0;
+}
+
+template class Frontend<Chip8>;
+template class Frontend<Chip8Extended<Chip8Classic, Chip8QuirksVip>>;
+template class Frontend<Chip8Extended<Chip8Classic, Chip8QuirksChip48>>;
+template class Frontend<Chip8Extended<Chip8Classic, Chip8QuirksSuperChip>>;
+template class Frontend<Chip8Extended<Chip8Classic, Chip8QuirksModern>>;
+template class Frontend<Chip8Extended<Chip8SuperChip, Chip8QuirksVip>>;
+template class Frontend<Chip8Extended<Chip8SuperChip, Chip8QuirksChip48>>;
+template class Frontend<Chip8Extended<Chip8SuperChip, Chip8QuirksSuperChip>>;
+template class Frontend<Chip8Extended<Chip8SuperChip, Chip8QuirksModern>>;
+template class Frontend<Chip8Extended<Chip8XoChip, Chip8QuirksVip>>;
+template class Frontend<Chip8Extended<Chip8XoChip, Chip8QuirksChip48>>;
+template class Frontend<Chip8Extended<Chip8XoChip, Chip8QuirksSuperChip>>;
+template class Frontend<Chip8Extended<Chip8XoChip, Chip8QuirksModern>>;
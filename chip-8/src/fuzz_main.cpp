@@ -0,0 +1,467 @@
+#include <vector>
+#include <string>
+#include <span>
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chip8.h"
+#include "chip8_jit.h"
+#include "chip8_lockstep.h"
+#include "seeded_input.h"
+
+// Differential fuzzer for the execution engines. Each input is decoded into a
+// ROM, optionally a scrambled initial machine state, and a frame schedule
+// with scripted keys. Every engine runs the same case and the final states
+// are compared against the switch interpreter, the reference. Chip8Lockstep
+// runs the case on lockstepLanes machines, each with its own key seed, and
+// every lane is checked against a reference run with the same keys. On a
+// mismatch the case is re-run for fewer cycles until the first diverging
+// instruction is found.
+//
+// Built with CHIP8_LIBFUZZER, libFuzzer supplies main() and drives
+// LLVMFuzzerTestOneInput(). Otherwise main() below generates cases from a
+// seed, or replays input files given on the command line.
+
+namespace {
+  struct Engine {
+    const char *name;
+    Chip8Dispatch dispatch;
+    bool jit;
+    bool lockstep; // Chip8Lockstep cannot restore a state, so it only runs power-on cases
+    bool idleSkipping; // Chip8::setIdleSkipping()
+  };
+
+  const Engine engines[] = {
+    { "switch", Chip8Dispatch_SWITCH, false, false, false }, // Reference, every instruction executed
+    { "switch+idle", Chip8Dispatch_SWITCH, false, false, true },
+    { "predecoded", Chip8Dispatch_PREDECODED, false, false, true },
+    { "table", Chip8Dispatch_TABLE, false, false, true },
+    { "threaded", Chip8Dispatch_THREADED, false, false, true },
+    { "jit", Chip8Dispatch_PREDECODED, true, false, true },
+    { "lockstep", Chip8Dispatch_SWITCH, false, true, false },
+  };
+
+  // More than one Chip8Lockstep::laneBlock, so a full block and a padded one
+  // both run, and the lanes split up as soon as their keys differ
+  constexpr unsigned int lockstepLanes = 40;
+
+  // Input layout: u8 flags (bit 0: scramble the state), u64 CXNN seed,
+  // u16 key seed, u8 cycles per frame, u8 frames, then 63 bytes of state
+  // if scrambled (u16 pc, u16 index, u8 sp, u8 delay, u8 sound, u8 v[16],
+  // u16 stack[16], u64 random state), then the ROM. Missing bytes read as 0.
+  struct FuzzCase {
+    std::span<const unsigned char> rom;
+    unsigned long long seed;
+    unsigned long long keySeed;
+    unsigned int cyclesPerFrame;
+    unsigned int frames;
+    bool scrambled;
+    std::vector<unsigned char> state; // Snapshot to start from when scrambled
+  };
+
+  struct MachineState {
+    unsigned char v[16];
+    unsigned short index, pc, sp;
+    unsigned char delayTimer, soundTimer;
+    unsigned char memory[4096];
+    unsigned long long vram[32];
+  };
+
+  class ByteReader {
+  private:
+    const unsigned char *data;
+    size_t size;
+    size_t position;
+
+  public:
+    ByteReader(const unsigned char *data, size_t size) : data(data), size(size), position(0) {}
+
+    unsigned long long get(int bytes) { // Little-endian
+      unsigned long long value = 0;
+      for (int i = 0; i < bytes; i++, position++) {
+        value |= (unsigned long long)(position < size ? data[position] : 0) << (8 * i);
+      }
+      return value;
+    }
+
+    std::span<const unsigned char> rest() const { return position < size ? std::span(data + position, size - position) : std::span<const unsigned char>(); }
+  };
+
+  Chip8Jit jit; // Shared by every run, flushed in between
+
+  FuzzCase decodeCase(const unsigned char *data, size_t size) {
+    ByteReader reader(data, size);
+    FuzzCase fuzzCase;
+
+    unsigned int flags = (unsigned int)reader.get(1);
+    fuzzCase.scrambled = flags & 1;
+    fuzzCase.seed = reader.get(8);
+    fuzzCase.keySeed = reader.get(2);
+    fuzzCase.cyclesPerFrame = 1 + (unsigned int)reader.get(1) % 100;
+    fuzzCase.frames = 1 + (unsigned int)reader.get(1) % 32;
+
+    std::vector<unsigned char> header;
+    if (fuzzCase.scrambled) {
+      for (int i = 0; i < 63; i++) {
+        header.push_back((unsigned char)reader.get(1));
+      }
+    }
+
+    fuzzCase.rom = reader.rest();
+    if (fuzzCase.rom.size() > Chip8::maxProgramSize) {
+      fuzzCase.rom = fuzzCase.rom.first(Chip8::maxProgramSize);
+    }
+
+    // Patch the core block of a power-on snapshot, layout in chip8_snapshot.cpp
+    if (fuzzCase.scrambled) {
+      Chip8 chip8(fuzzCase.rom, fuzzCase.seed);
+      fuzzCase.state = chip8.snapshot();
+      unsigned char *core = &fuzzCase.state[6];
+      core[0] = header[0];
+      core[1] = header[1] & 0x0F; // pc stays inside memory, the engines agree on nothing else
+      memcpy(core + 2, &header[2], 5); // index, sp, delay, sound
+      memcpy(core + 10, &header[7], 16); // v
+      memcpy(core + 26, &header[23], 32); // stack
+      memcpy(core + 66, &header[55], 8); // random state
+    }
+
+    return fuzzCase;
+  }
+
+  template <typename Machine>
+  void capture(const Machine &chip8, MachineState &state) {
+    for (int i = 0; i < 16; i++) {
+      state.v[i] = chip8.getRegister(i);
+    }
+    state.index = chip8.getIndex();
+    state.pc = chip8.getPC();
+    state.sp = chip8.getSP();
+    state.delayTimer = chip8.getDelayTimer();
+    state.soundTimer = chip8.getSoundTimer();
+    for (int i = 0; i < 4096; i++) {
+      state.memory[i] = chip8.peekMemory(i);
+    }
+    memcpy(state.vram, chip8.getVRAM(), sizeof(state.vram));
+  }
+
+  // One lane of a Chip8Lockstep, seen through the Chip8 accessors
+  struct LockstepView {
+    const Chip8Lockstep &lockstep;
+    unsigned int lane;
+    unsigned char getRegister(unsigned char x) const { return lockstep.getRegister(lane, x); }
+    unsigned short getIndex() const { return lockstep.getIndex(lane); }
+    unsigned short getPC() const { return lockstep.getPC(lane); }
+    unsigned short getSP() const { return lockstep.getSP(lane); }
+    unsigned char getDelayTimer() const { return lockstep.getDelayTimer(lane); }
+    unsigned char getSoundTimer() const { return lockstep.getSoundTimer(lane); }
+    unsigned char peekMemory(unsigned short address) const { return lockstep.peekMemory(lane, address); }
+    const unsigned long long *getVRAM() const { return lockstep.getVRAM(lane); }
+  };
+
+  unsigned long long laneKeySeed(const FuzzCase &fuzzCase, unsigned int lane) { return fuzzCase.keySeed + lane; } // Lane 0 gets the case's own keys
+
+  // The state of each lane after cycles instructions, lane i pressing the keys
+  // of laneKeySeed(i). Chip8Lockstep runs all lanes together, the other
+  // engines run one machine per lane. Timers tick only after complete frames,
+  // so a shorter run is always a prefix of a longer one.
+  void runEngine(const Engine &engine, const FuzzCase &fuzzCase, unsigned long long cycles, std::vector<MachineState> &states) {
+    unsigned int lanes = (unsigned int)states.size();
+
+    if (engine.lockstep) {
+      Chip8Lockstep lockstep(fuzzCase.rom.data(), (unsigned int)fuzzCase.rom.size(), lanes);
+      std::vector<SeededInput> inputs;
+      for (unsigned int lane = 0; lane < lanes; lane++) {
+        lockstep.seedRandom(lane, fuzzCase.seed);
+        inputs.emplace_back(laneKeySeed(fuzzCase, lane));
+      }
+      for (unsigned long long executed = 0; executed < cycles; executed += fuzzCase.cyclesPerFrame) {
+        unsigned long long frameCycles = std::min<unsigned long long>(fuzzCase.cyclesPerFrame, cycles - executed);
+        for (unsigned int lane = 0; lane < lanes; lane++) {
+          lockstep.setKeys(lane, inputs[lane].nextFrame());
+        }
+        lockstep.runCycles(frameCycles);
+        if (frameCycles == fuzzCase.cyclesPerFrame) {
+          lockstep.tickTimers();
+        }
+      }
+      for (unsigned int lane = 0; lane < lanes; lane++) {
+        capture(LockstepView{ lockstep, lane }, states[lane]);
+      }
+      return;
+    }
+
+    for (unsigned int lane = 0; lane < lanes; lane++) {
+      SeededInput input(laneKeySeed(fuzzCase, lane));
+      Chip8 chip8(fuzzCase.rom, fuzzCase.seed);
+      if (fuzzCase.scrambled) {
+        chip8.restore(fuzzCase.state);
+      }
+      chip8.setIdleSkipping(engine.idleSkipping);
+      jit.flush();
+
+      for (unsigned long long executed = 0; executed < cycles; executed += fuzzCase.cyclesPerFrame) {
+        unsigned long long frameCycles = std::min<unsigned long long>(fuzzCase.cyclesPerFrame, cycles - executed);
+        chip8.setKeys(input.nextFrame());
+        if (engine.jit) {
+          jit.runCycles(chip8, frameCycles);
+        }
+        else {
+          chip8.runCycles(frameCycles, engine.dispatch);
+        }
+        if (frameCycles == fuzzCase.cyclesPerFrame) {
+          chip8.tickTimers();
+        }
+      }
+      capture(chip8, states[lane]);
+    }
+  }
+
+  // Describes the first field that differs, empty if the states match
+  std::string compareStates(const MachineState &expected, const MachineState &actual) {
+    char text[128];
+    for (int i = 0; i < 16; i++) {
+      if (expected.v[i] != actual.v[i]) {
+        snprintf(text, sizeof(text), "V%X: 0x%02X, expected 0x%02X", i, actual.v[i], expected.v[i]);
+        return text;
+      }
+    }
+    if (expected.index != actual.index) {
+      snprintf(text, sizeof(text), "index: 0x%04X, expected 0x%04X", actual.index, expected.index);
+      return text;
+    }
+    if (expected.pc != actual.pc) {
+      snprintf(text, sizeof(text), "pc: 0x%04X, expected 0x%04X", actual.pc, expected.pc);
+      return text;
+    }
+    if (expected.sp != actual.sp) {
+      snprintf(text, sizeof(text), "sp: %u, expected %u", actual.sp, expected.sp);
+      return text;
+    }
+    if (expected.delayTimer != actual.delayTimer || expected.soundTimer != actual.soundTimer) {
+      snprintf(text, sizeof(text), "timers: DT %u ST %u, expected DT %u ST %u", actual.delayTimer, actual.soundTimer, expected.delayTimer, expected.soundTimer);
+      return text;
+    }
+    for (int i = 0; i < 4096; i++) {
+      if (expected.memory[i] != actual.memory[i]) {
+        snprintf(text, sizeof(text), "memory[0x%03X]: 0x%02X, expected 0x%02X", i, actual.memory[i], expected.memory[i]);
+        return text;
+      }
+    }
+    for (int y = 0; y < 32; y++) {
+      if (expected.vram[y] != actual.vram[y]) {
+        snprintf(text, sizeof(text), "VRAM row %d: %016llX, expected %016llX", y, actual.vram[y], expected.vram[y]);
+        return text;
+      }
+    }
+    return "";
+  }
+
+  // First lane whose states differ, -1 if every lane matches
+  int divergingLane(const std::vector<MachineState> &expected, const std::vector<MachineState> &actual) {
+    for (size_t lane = 0; lane < expected.size(); lane++) {
+      if (!compareStates(expected[lane], actual[lane]).empty()) {
+        return (int)lane;
+      }
+    }
+    return -1;
+  }
+
+  // Runs every engine against the reference, false and a report on stderr if any diverges
+  bool checkCase(const unsigned char *data, size_t size) {
+    FuzzCase fuzzCase = decodeCase(data, size);
+    unsigned long long cycles = (unsigned long long)fuzzCase.cyclesPerFrame * fuzzCase.frames;
+
+    // Heap allocated, each one carries a copy of memory
+    std::vector<MachineState> expected(1);
+    std::vector<MachineState> actual;
+    runEngine(engines[0], fuzzCase, cycles, expected);
+
+    for (size_t e = 1; e < sizeof(engines) / sizeof(engines[0]); e++) {
+      const Engine &engine = engines[e];
+      if (engine.lockstep && fuzzCase.scrambled) {
+        continue;
+      }
+
+      unsigned int lanes = engine.lockstep ? lockstepLanes : 1;
+      if (expected.size() != lanes) {
+        expected.resize(lanes);
+        runEngine(engines[0], fuzzCase, cycles, expected);
+      }
+      actual.resize(lanes);
+      runEngine(engine, fuzzCase, cycles, actual);
+      int lane = divergingLane(expected, actual);
+      if (lane < 0) {
+        continue;
+      }
+
+      // Narrow down to the first instruction after which that lane differs
+      unsigned long long good = 0;
+      unsigned long long bad = cycles;
+      runEngine(engines[0], fuzzCase, 0, expected);
+      runEngine(engine, fuzzCase, 0, actual);
+      if (!compareStates(expected[lane], actual[lane]).empty()) {
+        bad = 0;
+      }
+      while (bad - good > 1) {
+        unsigned long long middle = good + (bad - good) / 2;
+        runEngine(engines[0], fuzzCase, middle, expected);
+        runEngine(engine, fuzzCase, middle, actual);
+        if (compareStates(expected[lane], actual[lane]).empty()) {
+          good = middle;
+        }
+        else {
+          bad = middle;
+        }
+      }
+
+      runEngine(engines[0], fuzzCase, good, expected);
+      unsigned short pc = expected[lane].pc & 0xFFF;
+      unsigned short opcode = (expected[lane].memory[pc] << 8) | expected[lane].memory[(pc + 1) & 0xFFF];
+      runEngine(engines[0], fuzzCase, bad, expected);
+      runEngine(engine, fuzzCase, bad, actual);
+
+      fprintf(stderr, "%s diverges from %s at cycle %llu", engine.name, engines[0].name, bad);
+      if (bad > 0) {
+        fprintf(stderr, ", after %04X at 0x%03X", opcode, pc);
+      }
+      if (lanes > 1) {
+        fprintf(stderr, ", lane %d of %u (key seed %llu)", lane, lanes, laneKeySeed(fuzzCase, lane));
+      }
+      fprintf(stderr, "\n  %s\n  %s state, %u cycles per frame, ROM of %zu bytes\n", compareStates(expected[lane], actual[lane]).c_str(),
+        fuzzCase.scrambled ? "scrambled" : "power-on", fuzzCase.cyclesPerFrame, fuzzCase.rom.size());
+      return false;
+    }
+
+    return true;
+  }
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const unsigned char *data, size_t size) {
+  if (!checkCase(data, size)) {
+    abort(); // libFuzzer saves the input as a crash
+  }
+  return 0;
+}
+
+#if !defined(CHIP8_LIBFUZZER)
+
+// xorshift64, for case generation only
+static unsigned long long nextRandom(unsigned long long &state) {
+  state ^= state << 13;
+  state ^= state >> 7;
+  state ^= state << 17;
+  return state;
+}
+
+// A case whose ROM is mostly valid instructions, with jumps, calls and
+// index loads pointing back into the ROM so that the programs actually run
+static std::vector<unsigned char> generateCase(unsigned long long &random) {
+  std::vector<unsigned char> data;
+  for (int i = 0; i < 1 + 8 + 2 + 1 + 1 + 63; i++) {
+    data.push_back((unsigned char)nextRandom(random));
+  }
+
+  unsigned int instructions = 8 + (unsigned int)(nextRandom(random) % 248);
+  for (unsigned int i = 0; i < instructions; i++) {
+    unsigned long long r = nextRandom(random);
+
+    // Now and then a wait loop: FX07, SE/SNE VX, NN, JP back to the FX07
+    if (r % 32 == 0 && i + 3 <= instructions) {
+      unsigned short x = (r >> 8) & 0xF;
+      unsigned short start = 0x200 + i * 2;
+      unsigned short loop[3] = { (unsigned short)(0xF007 | x << 8), (unsigned short)(((r >> 12) % 2 ? 0x3000 : 0x4000) | x << 8 | ((r >> 16) % 4)), (unsigned short)(0x1000 | start) };
+      for (unsigned short opcode : loop) {
+        data.push_back((unsigned char)(opcode >> 8));
+        data.push_back((unsigned char)opcode);
+      }
+      i += 2;
+      continue;
+    }
+
+    unsigned short opcode = (unsigned short)r;
+    unsigned short high = opcode & 0xF000;
+    if ((high == 0x1000 || high == 0x2000 || high == 0xA000 || high == 0xB000) && (r >> 16) % 4 != 0) {
+      opcode = high | (0x200 + (unsigned short)((r >> 20) % instructions) * 2);
+    }
+    else if (high == 0x0000 && (r >> 16) % 4 != 0) {
+      opcode = (r >> 20) % 2 ? 0x00E0 : 0x00EE;
+    }
+    else if (high == 0xF000 && (r >> 16) % 4 == 0) {
+      opcode = (opcode & 0x0F00) | 0xF00A;
+    }
+    data.push_back((unsigned char)(opcode >> 8));
+    data.push_back((unsigned char)opcode);
+  }
+
+  return data;
+}
+
+int main(int argc, char **argv) {
+  // Flags may appear anywhere, the rest are input files to replay
+  std::vector<const char *> positional;
+  unsigned long long iterations = 10000;
+  unsigned long long seed = 1;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) {
+      iterations = strtoull(argv[++i], NULL, 0);
+    }
+    else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+      seed = strtoull(argv[++i], NULL, 0);
+    }
+    else if (argv[i][0] == '-') {
+      fprintf(stderr, "Usage: %s [--iterations N] [--seed N] [inputs...]\n", argv[0]);
+      return 1;
+    }
+    else {
+      positional.push_back(argv[i]);
+    }
+  }
+
+  if (!positional.empty()) {
+    int failures = 0;
+    for (const char *path : positional) {
+      FILE *file = fopen(path, "rb");
+      if (!file) {
+        fprintf(stderr, "Could not open %s\n", path);
+        return 1;
+      }
+      std::vector<unsigned char> data;
+      int c;
+      while ((c = fgetc(file)) != EOF) {
+        data.push_back((unsigned char)c);
+      }
+      fclose(file);
+
+      bool passed = checkCase(data.data(), data.size());
+      printf("%s: %s\n", path, passed ? "ok" : "DIVERGED");
+      failures += passed ? 0 : 1;
+    }
+    return failures ? 1 : 0;
+  }
+
+  unsigned long long random = seed * 0x9E3779B97F4A7C15ULL | 1;
+  for (unsigned long long i = 0; i < iterations; i++) {
+    std::vector<unsigned char> data = generateCase(random);
+    if (checkCase(data.data(), data.size())) {
+      continue;
+    }
+
+    // Same format libFuzzer and the replay mode read
+    char path[64];
+    snprintf(path, sizeof(path), "divergence-%llu-%llu.bin", seed, i);
+    FILE *file = fopen(path, "wb");
+    if (file) {
+      fwrite(data.data(), 1, data.size(), file);
+      fclose(file);
+      fprintf(stderr, "  case written to %s\n", path);
+    }
+    return 1;
+  }
+
+  printf("%llu cases, no divergence\n", iterations);
+  return 0;
+}
+
+#endif
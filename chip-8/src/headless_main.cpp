@@ -0,0 +1,302 @@
+#include <vector>
+#include <span>
+#include <chrono>
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chip8.h"
+#include "chip8_extended.h"
+#include "chip8_input_trace.h"
+#include "chip8_profiler.h"
+#include "chip8_analyzer.h"
+#include "chip8_frame_hasher.h"
+#include "rom_library.h"
+#include "beeper.h"
+#include "wav_writer.h"
+
+// SUPER-CHIP, XO-CHIP and quirk profile runs. No replay or profiling here,
+// those only exist for the classic machine.
+template <typename Mode, typename Quirks>
+static int runExtended(std::span<const unsigned char> gameData, unsigned long long maxCycles, unsigned long long cyclesPerFrame, unsigned long long seed) {
+  if (gameData.size() > Mode::memorySize - 512) {
+    fprintf(stderr, "ROM does not fit in %u bytes of memory\n", Mode::memorySize);
+    return 1;
+  }
+
+  Chip8Extended<Mode, Quirks> chip8(gameData.data(), (unsigned int)gameData.size(), seed);
+
+  auto start = std::chrono::steady_clock::now();
+
+  while (chip8.getCycles() < maxCycles && !chip8.isHalted()) {
+    unsigned long long frameEnd = chip8.getCycles() + cyclesPerFrame;
+    chip8.runUntil([&](const Chip8Extended<Mode, Quirks> &c) {
+      return c.getCycles() >= frameEnd || c.getCycles() >= maxCycles || c.isHalted();
+    });
+    chip8.tickTimers();
+  }
+
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  printf("cycles: %llu\n", chip8.getCycles());
+  printf("seconds: %.6f\n", seconds);
+  printf("instructions/second: %.0f\n", seconds > 0 ? chip8.getCycles() / seconds : 0.0);
+  printf("halted: %s\n", chip8.isHalted() ? "yes" : "no");
+  printf("quirks: %s\n", Quirks::name);
+  printf("pc: 0x%04X index: 0x%04X sp: %u\n", chip8.getPC(), chip8.getIndex(), chip8.getSP());
+  for (int i = 0; i < 16; i++) {
+    printf("V%X: 0x%02X%s", i, chip8.getRegister(i), (i % 8 == 7) ? "\n" : " ");
+  }
+
+  // Dump the final display at the active resolution, one character per plane combination
+  static const char shades[4] = { '.', '#', '+', '@' };
+  int scale = chip8.isHires() ? 1 : 2;
+  for (int y = 0; y < 64; y += scale) {
+    for (int x = 0; x < 128; x += scale) {
+      putchar(shades[chip8.getPixel(x, y)]);
+    }
+    putchar('\n');
+  }
+
+  return 0;
+}
+
+// Picks the quirk profile, the mode's own when quirks is null
+template <typename Mode>
+static int runWithQuirks(const char *quirks, std::span<const unsigned char> gameData, unsigned long long maxCycles, unsigned long long cyclesPerFrame, unsigned long long seed) {
+  if (!quirks) {
+    return runExtended<Mode, typename Mode::DefaultQuirks>(gameData, maxCycles, cyclesPerFrame, seed);
+  }
+  else if (strcmp(quirks, Chip8QuirksVip::name) == 0) {
+    return runExtended<Mode, Chip8QuirksVip>(gameData, maxCycles, cyclesPerFrame, seed);
+  }
+  else if (strcmp(quirks, Chip8QuirksChip48::name) == 0) {
+    return runExtended<Mode, Chip8QuirksChip48>(gameData, maxCycles, cyclesPerFrame, seed);
+  }
+  else if (strcmp(quirks, Chip8QuirksSuperChip::name) == 0) {
+    return runExtended<Mode, Chip8QuirksSuperChip>(gameData, maxCycles, cyclesPerFrame, seed);
+  }
+  else if (strcmp(quirks, Chip8QuirksModern::name) == 0) {
+    return runExtended<Mode, Chip8QuirksModern>(gameData, maxCycles, cyclesPerFrame, seed);
+  }
+
+  fprintf(stderr, "Unknown quirk profile %s\n", quirks);
+  return 1;
+}
+
+// Runs a ROM without a display, as fast as the host allows. Timers are ticked
+// once every cyclesPerFrame instructions, emulating a 60 Hz frame at 60000 IPS.
+int main(int argc, char **argv) {
+  // Flags may appear anywhere, the rest are the positional arguments
+  std::vector<const char *> positional;
+  unsigned long long seed = 0;
+  const char *replayPath = NULL;
+  bool profile = false;
+  const char *foldedPath = NULL;
+  const char *mode = "chip8";
+  const char *quirks = NULL;
+  const char *wavPath = NULL;
+  const char *frameHashesPath = NULL;
+  bool analyze = false;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+      seed = strtoull(argv[++i], NULL, 0);
+    }
+    else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+      replayPath = argv[++i];
+    }
+    else if (strcmp(argv[i], "--mode") == 0 && i + 1 < argc) {
+      mode = argv[++i];
+    }
+    else if (strcmp(argv[i], "--quirks") == 0 && i + 1 < argc) {
+      quirks = argv[++i];
+    }
+    else if (strcmp(argv[i], "--wav") == 0 && i + 1 < argc) {
+      wavPath = argv[++i];
+    }
+    else if (strcmp(argv[i], "--frame-hashes") == 0 && i + 1 < argc) {
+      frameHashesPath = argv[++i];
+    }
+    else if (strcmp(argv[i], "--analyze") == 0) {
+      analyze = true;
+    }
+    else if (strcmp(argv[i], "--profile") == 0) {
+      profile = true;
+    }
+    else if (strcmp(argv[i], "--folded") == 0 && i + 1 < argc) {
+      profile = true;
+      foldedPath = argv[++i];
+    }
+    else {
+      positional.push_back(argv[i]);
+    }
+  }
+
+  if (positional.empty()) {
+    fprintf(stderr, "Usage: %s <rom> [max cycles] [cycles per frame] [--mode chip8|schip|xochip] [--quirks vip|chip48|schip|modern] [--seed N] [--replay trace] [--profile] [--folded path] [--wav path] [--frame-hashes path] [--analyze]\n", argv[0]);
+    return 1;
+  }
+
+  unsigned long long maxCycles = positional.size() > 1 ? strtoull(positional[1], NULL, 0) : 10000000ULL;
+  unsigned long long cyclesPerFrame = positional.size() > 2 ? strtoull(positional[2], NULL, 0) : 1000ULL;
+
+  // A replayed run uses the seed and frame length it was recorded with
+  Chip8InputTrace trace(seed, (unsigned int)cyclesPerFrame);
+  if (replayPath) {
+    if (!trace.load(replayPath)) {
+      fprintf(stderr, "Could not read input trace %s\n", replayPath);
+      return 1;
+    }
+    cyclesPerFrame = trace.getCyclesPerFrame();
+  }
+
+  MappedFile rom;
+  if (!rom.open(positional[0])) {
+    fprintf(stderr, "Could not open %s\n", positional[0]);
+    return 1;
+  }
+  std::span<const unsigned char> gameData = rom.bytes();
+
+  // The plain classic machine has fixed quirks and the fast dispatchers,
+  // anything else runs on Chip8Extended
+  if (strcmp(mode, "chip8") != 0 || quirks) {
+    if (replayPath || profile || wavPath || frameHashesPath || analyze) {
+      fprintf(stderr, "--replay, --profile, --wav, --frame-hashes and --analyze need --mode chip8 without --quirks\n");
+      return 1;
+    }
+    if (strcmp(mode, "chip8") == 0) {
+      return runWithQuirks<Chip8Classic>(quirks, gameData, maxCycles, cyclesPerFrame, seed);
+    }
+    else if (strcmp(mode, "schip") == 0) {
+      return runWithQuirks<Chip8SuperChip>(quirks, gameData, maxCycles, cyclesPerFrame, seed);
+    }
+    else if (strcmp(mode, "xochip") == 0) {
+      return runWithQuirks<Chip8XoChip>(quirks, gameData, maxCycles, cyclesPerFrame, seed);
+    }
+  }
+
+  if (strcmp(mode, "chip8") != 0) {
+    fprintf(stderr, "Unknown mode %s\n", mode);
+    return 1;
+  }
+
+  if (gameData.size() > Chip8::maxProgramSize) {
+    fprintf(stderr, "%s is too large for CHIP-8 memory\n", positional[0]);
+    return 1;
+  }
+
+  Chip8 chip8(gameData, trace.getSeed());
+  Chip8Profiler profiler;
+
+  // Decode everything the analyzer can reach before the first frame
+  if (analyze) {
+    chip8.predecode(Chip8Analyzer(gameData).getInstructions());
+  }
+
+  // --wav renders the buzzer through the same Beeper the window plays, one
+  // 60 Hz frame of samples after each frame of emulation
+  constexpr unsigned int sampleRate = 44100;
+  Beeper beeper(sampleRate, cyclesPerFrame * 60.0);
+  WavWriter wav;
+  if (wavPath && !wav.open(wavPath, sampleRate)) {
+    fprintf(stderr, "Could not write %s\n", wavPath);
+    return 1;
+  }
+  std::vector<float> samples(sampleRate / 60 + 1);
+
+  // --frame-hashes writes one display hash per frame, rehashing only the
+  // rows the frame drew to
+  Chip8FrameHasher hasher;
+  FILE *frameHashes = NULL;
+  if (frameHashesPath && !(frameHashes = fopen(frameHashesPath, "w"))) {
+    fprintf(stderr, "Could not write %s\n", frameHashesPath);
+    return 1;
+  }
+
+  unsigned long long frames = 0;
+  unsigned long long samplesWritten = 0;
+
+  auto start = std::chrono::steady_clock::now();
+
+  // Halts are checked between frames, a machine that halts mid-frame spins
+  // out the rest of it (the idle skipping in runCycles() makes that cheap)
+  while (chip8.getCycles() < maxCycles && !chip8.isHalted()) {
+    unsigned long long frameCycles = std::min(cyclesPerFrame, maxCycles - chip8.getCycles());
+    if (replayPath) {
+      // Key changes land on their recorded cycle
+      trace.runCycles(chip8, frameCycles);
+    }
+    else if (profile) {
+      chip8.runObserved(frameCycles, profiler);
+    }
+    else {
+      chip8.runCycles(frameCycles);
+    }
+    chip8.tickTimers();
+    frames++;
+
+    if (frameHashes) {
+      fprintf(frameHashes, "%llu %016llx\n", frames, hasher.update(chip8.getVRAM(), chip8.getDirtyRows()));
+      chip8.clearVRAMDirty();
+    }
+
+    if (wavPath) {
+      const Chip8::SoundEdge *edges = chip8.getSoundEdges();
+      for (unsigned int i = 0; i < chip8.getSoundEdgeCount(); i++) {
+        beeper.setTone(edges[i].cycle, edges[i].on);
+      }
+      chip8.clearSoundEdges();
+
+      unsigned int count = (unsigned int)(frames * sampleRate / 60 - samplesWritten);
+      beeper.render(samples.data(), count);
+      wav.write(samples.data(), count);
+      samplesWritten += count;
+    }
+  }
+
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  printf("cycles: %llu\n", chip8.getCycles());
+  printf("seconds: %.6f\n", seconds);
+  printf("instructions/second: %.0f\n", seconds > 0 ? chip8.getCycles() / seconds : 0.0);
+  printf("halted: %s\n", chip8.isHalted() ? "yes" : "no");
+  printf("pc: 0x%03X index: 0x%03X sp: %u\n", chip8.getPC(), chip8.getIndex(), chip8.getSP());
+  for (int i = 0; i < 16; i++) {
+    printf("V%X: 0x%02X%s", i, chip8.getRegister(i), (i % 8 == 7) ? "\n" : " ");
+  }
+
+  // Dump the final display
+  for (int y = 0; y < 32; y++) {
+    for (int x = 0; x < 64; x++) {
+      putchar(chip8.getPixel(x, y) ? '#' : '.');
+    }
+    putchar('\n');
+  }
+
+  if (profile) {
+    putchar('\n');
+    profiler.writeReport(stdout);
+  }
+
+  if (frameHashes) {
+    fclose(frameHashes);
+  }
+
+  if (wavPath && !wav.close()) {
+    fprintf(stderr, "Could not write %s\n", wavPath);
+    return 1;
+  }
+
+  if (foldedPath) {
+    FILE *folded = fopen(foldedPath, "w");
+    if (!folded) {
+      fprintf(stderr, "Could not write %s\n", foldedPath);
+      return 1;
+    }
+    profiler.writeFoldedStacks(folded);
+    fclose(folded);
+  }
+
+  return 0;
+}
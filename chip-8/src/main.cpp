@@ -1,23 +1,135 @@
-#include <fstream>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "chip8.h"
+#include "chip8_extended.h"
+#include "chip8_input_trace.h"
+#include "frontend.h"
+#include "rom_library.h"
+
+// SUPER-CHIP, XO-CHIP and quirk profile runs, without rewind or --record
+template <typename Mode, typename Quirks>
+static int runExtended(std::span<const unsigned char> rom, unsigned long long seed, int cyclesPerFrame, float phosphor) {
+  if (rom.size() > Mode::memorySize - 512) {
+    fprintf(stderr, "ROM does not fit in %u bytes of memory\n", Mode::memorySize);
+    return 1;
+  }
+
+  Chip8Extended<Mode, Quirks> chip8(rom, seed);
+  Frontend<Chip8Extended<Mode, Quirks>> frontend(chip8, cyclesPerFrame);
+  frontend.setPhosphor(phosphor);
+  return frontend.run();
+}
+
+// Picks the quirk profile, the mode's own when quirks is null
+template <typename Mode>
+static int runWithQuirks(const char *quirks, std::span<const unsigned char> rom, unsigned long long seed, int cyclesPerFrame, float phosphor) {
+  if (!quirks) {
+    return runExtended<Mode, typename Mode::DefaultQuirks>(rom, seed, cyclesPerFrame, phosphor);
+  }
+  else if (strcmp(quirks, Chip8QuirksVip::name) == 0) {
+    return runExtended<Mode, Chip8QuirksVip>(rom, seed, cyclesPerFrame, phosphor);
+  }
+  else if (strcmp(quirks, Chip8QuirksChip48::name) == 0) {
+    return runExtended<Mode, Chip8QuirksChip48>(rom, seed, cyclesPerFrame, phosphor);
+  }
+  else if (strcmp(quirks, Chip8QuirksSuperChip::name) == 0) {
+    return runExtended<Mode, Chip8QuirksSuperChip>(rom, seed, cyclesPerFrame, phosphor);
+  }
+  else if (strcmp(quirks, Chip8QuirksModern::name) == 0) {
+    return runExtended<Mode, Chip8QuirksModern>(rom, seed, cyclesPerFrame, phosphor);
+  }
+
+  fprintf(stderr, "Unknown quirk profile %s\n", quirks);
+  return 1;
+}
 
 int main(int arc, char **argv) {
 
-  // Read the game data from the file at argv[1]
-  std::ifstream file(argv[1], std::ios::binary);
-  if (!file.is_open()) {
+  // Flags may appear anywhere, the rest are the positional arguments
+  std::vector<const char *> positional;
+  unsigned long long seed = 0;
+  const char *recordPath = NULL;
+  float phosphor = 0.0F;
+  const char *mode = "chip8";
+  const char *quirks = NULL;
+  for (int i = 1; i < arc; i++) {
+    if (strcmp(argv[i], "--seed") == 0 && i + 1 < arc) {
+      seed = strtoull(argv[++i], NULL, 0);
+    }
+    else if (strcmp(argv[i], "--record") == 0 && i + 1 < arc) {
+      recordPath = argv[++i];
+    }
+    else if (strcmp(argv[i], "--phosphor") == 0 && i + 1 < arc) {
+      phosphor = strtof(argv[++i], NULL);
+    }
+    else if (strcmp(argv[i], "--mode") == 0 && i + 1 < arc) {
+      mode = argv[++i];
+    }
+    else if (strcmp(argv[i], "--quirks") == 0 && i + 1 < arc) {
+      quirks = argv[++i];
+    }
+    else {
+      positional.push_back(argv[i]);
+    }
+  }
+
+  if (positional.empty()) {
     return 1;
   }
 
-  file.seekg(0, std::ios::end);
-  int fileSize = file.tellg();
-  file.seekg(0, std::ios::beg);
+  // Map the ROM, Chip8 copies it straight into its memory
+  MappedFile rom;
+  if (!rom.open(positional[0])) {
+    return 1;
+  }
+
+  // Optional second argument: CPU cycles per 60 Hz frame, 1000 gives the usual 60000 Hz
+  int cyclesPerFrame = positional.size() > 1 ? atoi(positional[1]) : 1000;
+  if (cyclesPerFrame <= 0) {
+    return 1;
+  }
 
-  unsigned char *gameData = new unsigned char[fileSize];
-  file.read((char *)gameData, fileSize);
-  file.close();
+  // The plain classic machine has fixed quirks, rewind and exact sound,
+  // anything else runs on Chip8Extended like chip8-headless does
+  if (strcmp(mode, "chip8") != 0 || quirks) {
+    if (recordPath) {
+      fprintf(stderr, "--record needs --mode chip8 without --quirks\n");
+      return 1;
+    }
+    if (strcmp(mode, "chip8") == 0) {
+      return runWithQuirks<Chip8Classic>(quirks, rom.bytes(), seed, cyclesPerFrame, phosphor);
+    }
+    else if (strcmp(mode, "schip") == 0) {
+      return runWithQuirks<Chip8SuperChip>(quirks, rom.bytes(), seed, cyclesPerFrame, phosphor);
+    }
+    else if (strcmp(mode, "xochip") == 0) {
+      return runWithQuirks<Chip8XoChip>(quirks, rom.bytes(), seed, cyclesPerFrame, phosphor);
+    }
+    fprintf(stderr, "Unknown mode %s\n", mode);
+    return 1;
+  }
 
-  Chip8 chip8 = Chip8(gameData, fileSize);
-  return chip8.run();
+  if (rom.bytes().size() > Chip8::maxProgramSize) {
+    fprintf(stderr, "%s is too large for CHIP-8 memory\n", positional[0]);
+    return 1;
+  }
+
+  Chip8 chip8(rom.bytes(), seed);
+  rom.close();
+
+  // --record writes every key change to a trace that chip8-headless --replay reproduces
+  Chip8InputTrace recording(seed, cyclesPerFrame);
+
+  Frontend<Chip8> frontend(chip8, cyclesPerFrame, recordPath ? &recording : nullptr);
+  // --phosphor 0.6 keeps 60% of a pixel's brightness per frame after it goes dark, hiding XOR flicker
+  frontend.setPhosphor(phosphor);
+  int result = frontend.run();
+
+  if (recordPath && !recording.save(recordPath)) {
+    return 1;
+  }
+  return result;
 }
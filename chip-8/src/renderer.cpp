@@ -0,0 +1,259 @@
+#include <math.h>
+#include <stdlib.h>
+#include <glad/gl.h>
+
+#include "renderer.h"
+
+static unsigned int compileProgram(const char *vertexShaderSource, const char *fragmentShaderSource) {
+  unsigned int vertexShader = glCreateShader(GL_VERTEX_SHADER);
+  glShaderSource(vertexShader, 1, &vertexShaderSource, NULL);
+  glCompileShader(vertexShader);
+
+  unsigned int fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+  glShaderSource(fragmentShader, 1, &fragmentShaderSource, NULL);
+  glCompileShader(fragmentShader);
+
+  unsigned int program = glCreateProgram();
+  glAttachShader(program, vertexShader);
+  glAttachShader(program, fragmentShader);
+  glLinkProgram(program);
+
+  glDeleteShader(vertexShader);
+  glDeleteShader(fragmentShader);
+  return program;
+}
+
+void Renderer::setup(int width, int height) {
+  this->width = width;
+  this->height = height;
+
+  const char *vertexShaderSource = R"(
+    #version 330 core
+    layout (location = 0) in vec2 aPos;
+    out vec2 uv;
+    void main() {
+      // Texture row 0 is the top of the screen
+      uv = vec2(aPos.x * 0.5 + 0.5, 0.5 - aPos.y * 0.5);
+      gl_Position = vec4(aPos, 0.0, 1.0);
+    }
+  )";
+
+  const char *fragmentShaderSource = R"(
+    #version 330 core
+    in vec2 uv;
+    out vec4 FragColor;
+    uniform sampler2D vram;
+    void main() {
+      // Nearest CHIP-8 pixel for this fragment, whatever the window scale
+      ivec2 size = textureSize(vram, 0);
+      ivec2 pixel = clamp(ivec2(uv * vec2(size)), ivec2(0), size - 1);
+      float lit = texelFetch(vram, pixel, 0).r;
+      FragColor = vec4(vec3(lit), 1.0);
+    }
+  )";
+
+  // Runs over a texture-sized viewport, so every fragment is exactly one texel
+  const char *decayShaderSource = R"(
+    #version 330 core
+    out vec4 FragColor;
+    uniform sampler2D vram;
+    uniform sampler2D previous;
+    uniform float persistence;
+    void main() {
+      ivec2 pixel = ivec2(gl_FragCoord.xy);
+      float lit = texelFetch(vram, pixel, 0).r;
+      float glow = texelFetch(previous, pixel, 0).r * persistence;
+      FragColor = vec4(max(lit, glow), 0.0, 0.0, 1.0);
+    }
+  )";
+
+  shaderProgram = compileProgram(vertexShaderSource, fragmentShaderSource);
+  decayProgram = compileProgram(vertexShaderSource, decayShaderSource);
+
+  // Fullscreen quad
+  float vertices[] = {
+    // Triangle 1
+    -1.0F, -1.0F,
+    1.0F, -1.0F,
+    -1.0F, 1.0F,
+    // Triangle 2
+    -1.0F, 1.0F,
+    1.0F, -1.0F,
+    1.0F, 1.0F
+  };
+
+  glGenVertexArrays(1, &vao);
+  glGenBuffers(1, &vbo);
+
+  glBindVertexArray(vao);
+
+  glBindBuffer(GL_ARRAY_BUFFER, vbo);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+
+  glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void *)0);
+  glEnableVertexAttribArray(0);
+
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  glBindVertexArray(0);
+
+  // VRAM texture, one byte per pixel
+  glGenTextures(1, &vramTexture);
+  glBindTexture(GL_TEXTURE_2D, vramTexture);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, width, height, 0, GL_RED, GL_UNSIGNED_BYTE, NULL);
+
+  // Accumulation textures, each the color attachment of its own framebuffer
+  glGenTextures(2, accumTextures);
+  glGenFramebuffers(2, accumFramebuffers);
+  for (int i = 0; i < 2; i++) {
+    glBindTexture(GL_TEXTURE_2D, accumTextures[i]);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R16F, width, height, 0, GL_RED, GL_FLOAT, NULL);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, accumFramebuffers[i]);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, accumTextures[i], 0);
+  }
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  accumCurrent = 0;
+  clearAccumulation();
+
+  glUseProgram(shaderProgram);
+  glUniform1i(glGetUniformLocation(shaderProgram, "vram"), 0);
+
+  glUseProgram(decayProgram);
+  glUniform1i(glGetUniformLocation(decayProgram, "vram"), 0);
+  glUniform1i(glGetUniformLocation(decayProgram, "previous"), 1);
+  persistenceUniform = glGetUniformLocation(decayProgram, "persistence");
+
+  persistence = 0.0F;
+  fadeLength = 0;
+  fadeFrames = 0;
+}
+
+void Renderer::teardown() {
+  glDeleteFramebuffers(2, accumFramebuffers);
+  glDeleteTextures(2, accumTextures);
+  glDeleteTextures(1, &vramTexture);
+  glDeleteBuffers(1, &vbo);
+  glDeleteVertexArrays(1, &vao);
+  glDeleteProgram(decayProgram);
+  glDeleteProgram(shaderProgram);
+}
+
+void Renderer::clearAccumulation() {
+  glClearColor(0.0F, 0.0F, 0.0F, 1.0F);
+  for (int i = 0; i < 2; i++) {
+    glBindFramebuffer(GL_FRAMEBUFFER, accumFramebuffers[i]);
+    glClear(GL_COLOR_BUFFER_BIT);
+  }
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void Renderer::setPersistence(float persistence) {
+  // 1 would never let go of a pixel
+  persistence = persistence < 0.0F ? 0.0F : persistence > 0.99F ? 0.99F : persistence;
+
+  // Stale glow from an earlier setting would otherwise flash up
+  if (this->persistence == 0.0F && persistence > 0.0F) {
+    clearAccumulation();
+  }
+
+  this->persistence = persistence;
+  fadeLength = persistence > 0.0F ? (int)ceilf(logf(1.0F / 512.0F) / logf(persistence)) : 0;
+  fadeFrames = 0;
+
+  glUseProgram(decayProgram);
+  glUniform1f(persistenceUniform, persistence);
+}
+
+void Renderer::upload(const unsigned long long *vram, unsigned int rows) {
+  glBindTexture(GL_TEXTURE_2D, vramTexture);
+
+  // One sub-image per run of consecutive changed rows
+  int y = 0;
+  while (y < 32) {
+    if (!((rows >> y) & 1)) {
+      y++;
+      continue;
+    }
+
+    int first = y;
+    for (; y < 32 && ((rows >> y) & 1); y++) {
+      // Expand the packed row to one byte per pixel
+      unsigned long long row = vram[y];
+      for (int x = 0; x < 64; x++) {
+        pixels[y * 64 + x] = ((row >> (63 - x)) & 1) ? 255 : 0;
+      }
+    }
+
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, first, 64, y - first, GL_RED, GL_UNSIGNED_BYTE, &pixels[first * 64]);
+  }
+
+  // Anything that went dark now has to fade out
+  if (rows) {
+    fadeFrames = fadeLength;
+  }
+}
+
+void Renderer::uploadPlanes(const unsigned long long *planes, int planeCount) {
+  // Grey levels for the four plane combinations, plane 0 alone is white
+  static const unsigned char shades[4] = { 0, 255, 170, 85 };
+
+  for (int y = 0; y < 64; y++) {
+    for (int x = 0; x < 128; x++) {
+      int shade = 0;
+      for (int plane = 0; plane < planeCount; plane++) {
+        unsigned long long word = planes[plane * 128 + y * 2 + x / 64];
+        shade |= ((word >> (63 - x % 64)) & 1) << plane;
+      }
+      pixels[y * 128 + x] = shades[shade];
+    }
+  }
+
+  glBindTexture(GL_TEXTURE_2D, vramTexture);
+  glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 128, 64, GL_RED, GL_UNSIGNED_BYTE, pixels);
+  fadeFrames = fadeLength;
+}
+
+void Renderer::draw() {
+  glBindVertexArray(vao);
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, vramTexture);
+
+  if (persistence > 0.0F) {
+    // Blend VRAM over the decayed last draw into the other texture
+    int next = accumCurrent ^ 1;
+    int viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, accumFramebuffers[next]);
+    glViewport(0, 0, width, height);
+    glUseProgram(decayProgram);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, accumTextures[accumCurrent]);
+    glDrawArrays(GL_TRIANGLES, 0, 6);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+    accumCurrent = next;
+
+    // The quad shows the accumulation in place of VRAM
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, accumTextures[accumCurrent]);
+
+    if (fadeFrames > 0) {
+      fadeFrames--;
+    }
+  }
+
+  glUseProgram(shaderProgram);
+  glDrawArrays(GL_TRIANGLES, 0, 6);
+  glBindVertexArray(0);
+}
@@ -0,0 +1,269 @@
+#include <fstream>
+#include <filesystem>
+#include <algorithm>
+#include <string.h>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "rom_library.h"
+
+namespace {
+  const unsigned char archiveMagic[4] = { 'C', '8', 'P', 'K' };
+  constexpr unsigned char archiveVersion = 1;
+  constexpr size_t archiveHeaderSize = 9; // Magic, version, count
+
+  unsigned int getU32(const unsigned char *p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
+  }
+
+  void putU32(std::vector<unsigned char> &out, unsigned int value) {
+    for (int i = 0; i < 4; i++) {
+      out.push_back((unsigned char)(value >> (8 * i)));
+    }
+  }
+}
+
+MappedFile::MappedFile() : data(nullptr), size(0) {
+#if defined(_WIN32)
+  file = INVALID_HANDLE_VALUE;
+  mapping = nullptr;
+#else
+  file = -1;
+#endif
+}
+
+MappedFile::~MappedFile() {
+  close();
+}
+
+bool MappedFile::open(const char *path) {
+  close();
+
+#if defined(_WIN32)
+  file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (file == INVALID_HANDLE_VALUE) {
+    return false;
+  }
+
+  LARGE_INTEGER fileSize;
+  if (!GetFileSizeEx(file, &fileSize)) {
+    close();
+    return false;
+  }
+  size = (size_t)fileSize.QuadPart;
+
+  // Empty files cannot be mapped, they are just an empty span
+  if (size > 0) {
+    mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    data = mapping ? (const unsigned char *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    if (!data) {
+      close();
+      return false;
+    }
+  }
+#else
+  file = ::open(path, O_RDONLY);
+  if (file < 0) {
+    return false;
+  }
+
+  struct stat info;
+  if (fstat(file, &info) != 0 || !S_ISREG(info.st_mode)) {
+    close();
+    return false;
+  }
+  size = (size_t)info.st_size;
+
+  // Empty files cannot be mapped, they are just an empty span
+  if (size > 0) {
+    void *mapped = mmap(NULL, size, PROT_READ, MAP_PRIVATE, file, 0);
+    if (mapped == MAP_FAILED) {
+      close();
+      return false;
+    }
+    data = (const unsigned char *)mapped;
+  }
+#endif
+
+  return true;
+}
+
+void MappedFile::close() {
+#if defined(_WIN32)
+  if (data) {
+    UnmapViewOfFile(data);
+  }
+  if (mapping) {
+    CloseHandle(mapping);
+  }
+  if (file != INVALID_HANDLE_VALUE) {
+    CloseHandle(file);
+  }
+  file = INVALID_HANDLE_VALUE;
+  mapping = nullptr;
+#else
+  if (data) {
+    munmap((void *)data, size);
+  }
+  if (file >= 0) {
+    ::close(file);
+  }
+  file = -1;
+#endif
+
+  data = nullptr;
+  size = 0;
+}
+
+unsigned long long RomLibrary::hashContent(std::span<const unsigned char> data) {
+  // FNV-1a, byte at a time, with the length mixed in last
+  unsigned long long hash = 14695981039346656037ULL;
+  for (unsigned char byte : data) {
+    hash ^= byte;
+    hash *= 1099511628211ULL;
+  }
+  hash ^= data.size();
+  hash *= 1099511628211ULL;
+  return hash;
+}
+
+bool RomLibrary::openDirectory(const char *path) {
+  std::error_code error;
+  std::filesystem::directory_iterator directory(path, error);
+  if (error) {
+    return false;
+  }
+
+  for (const auto &entry : directory) {
+    if (entry.path().extension() != ".ch8") {
+      continue;
+    }
+
+    auto file = std::make_unique<MappedFile>();
+    if (!file->open(entry.path().string().c_str())) {
+      continue;
+    }
+
+    addRom(std::move(file), entry.path().filename().string());
+  }
+
+  std::sort(roms.begin(), roms.end(), [](const Rom &a, const Rom &b) { return a.name < b.name; });
+  return true;
+}
+
+bool RomLibrary::addArchive(std::unique_ptr<MappedFile> file) {
+  std::span<const unsigned char> bytes = file->bytes();
+  if (bytes.size() < archiveHeaderSize || memcmp(bytes.data(), archiveMagic, 4) != 0 || bytes[4] != archiveVersion) {
+    return false;
+  }
+
+  // Validate the whole index before adding anything
+  unsigned int count = getU32(&bytes[5]);
+  std::vector<Rom> added;
+  size_t position = archiveHeaderSize;
+  for (unsigned int i = 0; i < count; i++) {
+    if (bytes.size() - position < 10) {
+      return false;
+    }
+
+    unsigned int offset = getU32(&bytes[position]);
+    unsigned int size = getU32(&bytes[position + 4]);
+    unsigned short nameLength = bytes[position + 8] | (bytes[position + 9] << 8);
+    position += 10;
+
+    if (bytes.size() - position < nameLength || offset > bytes.size() || bytes.size() - offset < size) {
+      return false;
+    }
+
+    std::span<const unsigned char> data = bytes.subspan(offset, size);
+    added.push_back({ std::string((const char *)&bytes[position], nameLength), data, hashContent(data) });
+    position += nameLength;
+  }
+
+  roms.insert(roms.end(), added.begin(), added.end());
+  std::sort(roms.begin(), roms.end(), [](const Rom &a, const Rom &b) { return a.name < b.name; });
+  files.push_back(std::move(file));
+  return true;
+}
+
+bool RomLibrary::openArchive(const char *path) {
+  auto file = std::make_unique<MappedFile>();
+  return file->open(path) && addArchive(std::move(file));
+}
+
+void RomLibrary::addRom(std::unique_ptr<MappedFile> file, const std::string &name) {
+  roms.push_back({ name, file->bytes(), hashContent(file->bytes()) });
+  files.push_back(std::move(file));
+}
+
+bool RomLibrary::openFile(const char *path) {
+  auto file = std::make_unique<MappedFile>();
+  if (!file->open(path)) {
+    return false;
+  }
+
+  addRom(std::move(file), std::filesystem::path(path).filename().string());
+  std::sort(roms.begin(), roms.end(), [](const Rom &a, const Rom &b) { return a.name < b.name; });
+  return true;
+}
+
+bool RomLibrary::open(const char *path) {
+  std::error_code error;
+  if (std::filesystem::is_directory(path, error)) {
+    return openDirectory(path);
+  }
+
+  auto file = std::make_unique<MappedFile>();
+  if (!file->open(path)) {
+    return false;
+  }
+
+  // Anything that does not start like an archive is a single ROM
+  std::span<const unsigned char> bytes = file->bytes();
+  if (bytes.size() >= 4 && memcmp(bytes.data(), archiveMagic, 4) == 0) {
+    return addArchive(std::move(file));
+  }
+
+  addRom(std::move(file), std::filesystem::path(path).filename().string());
+  std::sort(roms.begin(), roms.end(), [](const Rom &a, const Rom &b) { return a.name < b.name; });
+  return true;
+}
+
+bool RomLibrary::writeArchive(const char *path) const {
+  std::vector<unsigned char> out(archiveMagic, archiveMagic + 4);
+  out.push_back(archiveVersion);
+  putU32(out, (unsigned int)roms.size());
+
+  // Data follows the index, so the offsets are known once the index size is
+  size_t offset = archiveHeaderSize;
+  for (const Rom &rom : roms) {
+    offset += 10 + std::min(rom.name.size(), (size_t)0xFFFF);
+  }
+
+  for (const Rom &rom : roms) {
+    unsigned short nameLength = (unsigned short)std::min(rom.name.size(), (size_t)0xFFFF);
+    putU32(out, (unsigned int)offset);
+    putU32(out, (unsigned int)rom.data.size());
+    out.push_back((unsigned char)nameLength);
+    out.push_back((unsigned char)(nameLength >> 8));
+    out.insert(out.end(), rom.name.begin(), rom.name.begin() + nameLength);
+    offset += rom.data.size();
+  }
+
+  for (const Rom &rom : roms) {
+    out.insert(out.end(), rom.data.begin(), rom.data.end());
+  }
+
+  std::ofstream file(path, std::ios::binary);
+  file.write((const char *)out.data(), out.size());
+  return file.good();
+}
@@ -0,0 +1,114 @@
+#include "thread_pool.h"
+
+ThreadPool::ThreadPool(unsigned int threadCount) : queued(0), pending(0), nextQueue(0), stopping(false) {
+  if (threadCount == 0) {
+    threadCount = std::thread::hardware_concurrency();
+  }
+  if (threadCount == 0) {
+    threadCount = 1;
+  }
+
+  for (unsigned int i = 0; i < threadCount; i++) {
+    queues.push_back(std::make_unique<WorkQueue>());
+  }
+  for (unsigned int i = 0; i < threadCount; i++) {
+    threads.emplace_back(&ThreadPool::workerLoop, this, i);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(stateMutex);
+    stopping = true;
+  }
+  workAvailable.notify_all();
+
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+  unsigned int target;
+  {
+    std::lock_guard<std::mutex> lock(stateMutex);
+    target = nextQueue;
+    nextQueue = (nextQueue + 1) % queues.size();
+    pending++;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(queues[target]->mutex);
+    queues[target]->tasks.push_back(std::move(task));
+  }
+
+  // Only count the task as queued once it can actually be popped
+  {
+    std::lock_guard<std::mutex> lock(stateMutex);
+    queued++;
+  }
+  workAvailable.notify_one();
+}
+
+void ThreadPool::wait() {
+  std::unique_lock<std::mutex> lock(stateMutex);
+  allDone.wait(lock, [&] { return pending == 0; });
+}
+
+bool ThreadPool::popLocal(unsigned int worker, std::function<void()> &task) {
+  WorkQueue &queue = *queues[worker];
+  std::lock_guard<std::mutex> lock(queue.mutex);
+  if (queue.tasks.empty()) {
+    return false;
+  }
+
+  task = std::move(queue.tasks.back());
+  queue.tasks.pop_back();
+  return true;
+}
+
+bool ThreadPool::steal(unsigned int worker, std::function<void()> &task) {
+  // Start at the next worker so thieves do not all pile onto queue 0
+  for (unsigned int offset = 1; offset < queues.size(); offset++) {
+    WorkQueue &queue = *queues[(worker + offset) % queues.size()];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (!queue.tasks.empty()) {
+      task = std::move(queue.tasks.front());
+      queue.tasks.pop_front();
+      return true;
+    }
+  }
+  return false;
+}
+
+void ThreadPool::workerLoop(unsigned int worker) {
+  std::function<void()> task;
+
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(stateMutex);
+      workAvailable.wait(lock, [&] { return queued > 0 || stopping; });
+      if (queued == 0) {
+        return; // Stopping and nothing left to run
+      }
+      queued--;
+    }
+
+    // We reserved one task above, so one of these has to succeed eventually
+    while (!popLocal(worker, task) && !steal(worker, task)) {
+      std::this_thread::yield();
+    }
+
+    task();
+    task = nullptr;
+
+    bool finished;
+    {
+      std::lock_guard<std::mutex> lock(stateMutex);
+      finished = --pending == 0;
+    }
+    if (finished) {
+      allDone.notify_all();
+    }
+  }
+}
@@ -0,0 +1,67 @@
+#include "wav_writer.h"
+
+namespace {
+  void putU16(FILE *file, unsigned int value) {
+    fputc(value & 0xFF, file);
+    fputc((value >> 8) & 0xFF, file);
+  }
+
+  void putU32(FILE *file, unsigned int value) {
+    putU16(file, value & 0xFFFF);
+    putU16(file, value >> 16);
+  }
+
+  void writeHeader(FILE *file, unsigned int sampleRate, unsigned int dataBytes) {
+    fwrite("RIFF", 1, 4, file);
+    putU32(file, 36 + dataBytes);
+    fwrite("WAVEfmt ", 1, 8, file);
+    putU32(file, 16); // fmt chunk size
+    putU16(file, 1); // PCM
+    putU16(file, 1); // Mono
+    putU32(file, sampleRate);
+    putU32(file, sampleRate * 2); // Bytes per second
+    putU16(file, 2); // Bytes per frame
+    putU16(file, 16); // Bits per sample
+    fwrite("data", 1, 4, file);
+    putU32(file, dataBytes);
+  }
+}
+
+bool WavWriter::open(const char *path, unsigned int sampleRate) {
+  close();
+
+  file = fopen(path, "wb");
+  if (!file) {
+    return false;
+  }
+
+  this->sampleRate = sampleRate;
+  samples = 0;
+  writeHeader(file, sampleRate, 0); // Patched by close()
+  return true;
+}
+
+void WavWriter::write(const float *data, unsigned int count) {
+  if (!file) {
+    return;
+  }
+
+  for (unsigned int i = 0; i < count; i++) {
+    float sample = data[i] < -1.0F ? -1.0F : data[i] > 1.0F ? 1.0F : data[i];
+    putU16(file, (unsigned int)(short)(sample * 32767.0F) & 0xFFFF);
+  }
+  samples += count;
+}
+
+bool WavWriter::close() {
+  if (!file) {
+    return true;
+  }
+
+  fseek(file, 0, SEEK_SET);
+  writeHeader(file, sampleRate, (unsigned int)(samples * 2));
+  bool ok = !ferror(file);
+  ok &= fclose(file) == 0;
+  file = nullptr;
+  return ok;
+}